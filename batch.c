@@ -0,0 +1,563 @@
+#include "batch.h"
+
+#include <SDL2/SDL.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "canvas.h"
+#include "export.h"
+#include "fill.h"
+#include "history.h"
+#include "import.h"
+#include "project.h"
+#include "selection.h"
+
+#define BATCH_PATH_SIZE 1024
+
+// Job files, shared by the workers, which each take the next one until none
+// is left
+typedef struct
+{
+    char **files;
+    int count;
+    int capacity;
+    // Directory images of projects are written to, NULL for next to them
+    const char *output;
+    atomic_int next;
+    atomic_int failed;
+} BatchQueue;
+
+// Canvas a job works on, and the state commands change
+typedef struct
+{
+    const char *file_name;
+    int line;
+    Canvas canvas;
+    bool has_canvas;
+    History history;
+    BrushColors brush_colors;
+    int cell_size;
+    // Value painted by drawing commands
+    uint8_t brush;
+} BatchJob;
+
+static void batch_usage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: --batch [options] JOB...\n"
+        "  JOB is a project (*" PROJECT_EXTENSION "), exported to a PNG image, "
+        "a\n"
+        "  command script (*" BATCH_SCRIPT_EXTENSION "), or a directory of "
+        "both.\n"
+        "  --jobs N    run N jobs at a time (default: one per CPU core)\n"
+        "  --out DIR   write the images of projects to DIR\n"
+        "Script commands, one per line, file names relative to the script:\n"
+        "  size COLUMNS ROWS          new canvas, or resize the current one\n"
+        "  open FILE                  load a project\n"
+        "  import FILE [BLOCK]        paint a PNG image, one cell per BLOCK\n"
+        "                             pixels square\n"
+        "  cell N                     pixels per cell in exported images\n"
+        "  color N R G B              set brush color N, from 1\n"
+        "  brush N                    paint with color N, 0 to erase\n"
+        "  point ROW COL\n"
+        "  rect ROW COL ROWS COLS\n"
+        "  fill ROW COL [diagonal|replace]\n"
+        "  move ROW COL ROWS COLS DOWN RIGHT\n"
+        "  clear\n"
+        "  save FILE                  write a project\n"
+        "  export FILE                write a PNG image\n"
+    );
+}
+
+static bool batch_has_extension(const char *file_name, const char *extension)
+{
+    size_t length = strlen(file_name);
+    size_t size   = strlen(extension);
+    return length > size && strcmp(file_name + length - size, extension) == 0;
+}
+
+static bool batch_add(BatchQueue *queue, const char *file_name)
+{
+    if (queue->count == queue->capacity)
+    {
+        int capacity = queue->capacity > 0 ? queue->capacity * 2 : 64;
+        char **files = realloc(queue->files, capacity * sizeof(char *));
+        if (files == NULL)
+            return false;
+        queue->files    = files;
+        queue->capacity = capacity;
+    }
+
+    queue->files[queue->count] = strdup(file_name);
+    return queue->files[queue->count++] != NULL;
+}
+
+static int batch_compare(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Queues the projects and scripts in `directory`, in name order
+static bool batch_add_directory(BatchQueue *queue, const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to open directory '%s'\n", directory);
+        return false;
+    }
+
+    int first = queue->count;
+    bool ok   = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL)
+    {
+        if (!batch_has_extension(entry->d_name, PROJECT_EXTENSION) &&
+            !batch_has_extension(entry->d_name, BATCH_SCRIPT_EXTENSION))
+        {
+            continue;
+        }
+
+        char path[BATCH_PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        ok = batch_add(queue, path);
+    }
+    closedir(dir);
+
+    qsort(
+        queue->files + first,
+        queue->count - first,
+        sizeof(char *),
+        batch_compare
+    );
+    return ok;
+}
+
+static bool batch_error(BatchJob *job, const char *message)
+{
+    fprintf(stderr, "ERROR: %s:%i: %s\n", job->file_name, job->line, message);
+    return false;
+}
+
+// `name` taken relative to the directory of the job file
+static void batch_path(
+    BatchJob *job, const char *name, char *path, size_t size
+)
+{
+    const char *slash = strrchr(job->file_name, '/');
+    if (name[0] == '/' || slash == NULL)
+        snprintf(path, size, "%s", name);
+    else
+        snprintf(
+            path,
+            size,
+            "%.*s/%s",
+            (int)(slash - job->file_name),
+            job->file_name,
+            name
+        );
+}
+
+static bool batch_set_canvas(BatchJob *job, Canvas *canvas)
+{
+    if (canvas->rows > CANVAS_MAX_SIZE || canvas->columns > CANVAS_MAX_SIZE)
+    {
+        canvas_free(canvas);
+        return batch_error(job, "canvas too large");
+    }
+
+    if (job->has_canvas)
+        canvas_free(&job->canvas);
+    job->canvas     = *canvas;
+    job->has_canvas = true;
+    return true;
+}
+
+static bool batch_open(BatchJob *job, const char *file_name)
+{
+    Canvas canvas;
+    ProjectInfo project;
+    if (!project_load(file_name, &canvas, &project))
+        return batch_error(job, "cannot open project");
+
+    job->cell_size =
+        SDL_max(MIN_CELL_SIZE, SDL_min(project.cell_size, MAX_CELL_SIZE));
+    brush_colors_load(&job->brush_colors, &project);
+    return batch_set_canvas(job, &canvas);
+}
+
+static bool batch_import(BatchJob *job, const char *file_name, int block)
+{
+    PngReader image;
+    if (!png_open(&image, file_name))
+        return batch_error(job, "cannot open image");
+
+    // Without a canvas yet, the image decides its size
+    bool ok = true;
+    if (!job->has_canvas)
+    {
+        Canvas canvas;
+        int rows =
+            SDL_min((image.height + block - 1) / block, CANVAS_MAX_SIZE);
+        int columns =
+            SDL_min((image.width + block - 1) / block, CANVAS_MAX_SIZE);
+        ok = canvas_init(&canvas, rows, columns) &&
+             batch_set_canvas(job, &canvas);
+    }
+
+    if (ok)
+    {
+        ProjectInfo palette;
+        project_info(&job->brush_colors, job->cell_size, &palette);
+        ok = import_png(
+            &job->canvas,
+            &job->history,
+            &image,
+            (const uint8_t(*)[4])palette.colors,
+            palette.color_count,
+            block
+        );
+    }
+    png_close(&image);
+
+    return ok || batch_error(job, "cannot import image");
+}
+
+// Runs one script command. Returns false, with an error printed, if it
+// failed.
+static bool batch_command(BatchJob *job, const char *line)
+{
+    char command[16];
+    int length;
+    if (sscanf(line, " %15s%n", command, &length) != 1 || command[0] == '#')
+        return true;
+    const char *args = line + length;
+
+    char name[BATCH_PATH_SIZE];
+    char path[BATCH_PATH_SIZE];
+    int a, b, c, d, e, f;
+
+    if (strcmp(command, "size") == 0)
+    {
+        if (sscanf(args, "%i %i", &a, &b) != 2 || a < 1 ||
+            a > CANVAS_MAX_SIZE || b < 1 || b > CANVAS_MAX_SIZE)
+        {
+            return batch_error(job, "expected size COLUMNS ROWS");
+        }
+        if (job->has_canvas)
+        {
+            return canvas_resize(&job->canvas, b, a) ||
+                   batch_error(job, "cannot resize canvas");
+        }
+        Canvas canvas;
+        return canvas_init(&canvas, b, a) ? batch_set_canvas(job, &canvas)
+                                          : batch_error(job, "out of memory");
+    }
+
+    if (strcmp(command, "open") == 0 || strcmp(command, "import") == 0 ||
+        strcmp(command, "save") == 0 || strcmp(command, "export") == 0)
+    {
+        int count = sscanf(args, "%1023s %i", name, &a);
+        if (count < 1)
+            return batch_error(job, "expected a file name");
+        batch_path(job, name, path, sizeof(path));
+
+        if (command[0] == 'o')
+            return batch_open(job, path);
+        if (command[0] == 'i')
+        {
+            if (count < 2)
+                a = 1;
+            if (a < 1 || a > IMPORT_MAX_BLOCK)
+                return batch_error(job, "bad block size");
+            return batch_import(job, path, a);
+        }
+        if (!job->has_canvas)
+            return batch_error(job, "no canvas");
+        if (command[0] == 'e')
+        {
+            return save_as_png(
+                       &job->canvas,
+                       &job->brush_colors,
+                       job->cell_size,
+                       path,
+                       NULL
+                   ) ||
+                   batch_error(job, "cannot export image");
+        }
+
+        ProjectInfo info;
+        project_info(&job->brush_colors, job->cell_size, &info);
+        return project_save(path, &job->canvas, &info) ||
+               batch_error(job, "cannot save project");
+    }
+
+    if (strcmp(command, "cell") == 0)
+    {
+        if (sscanf(args, "%i", &a) != 1 || a < MIN_CELL_SIZE ||
+            a > MAX_CELL_SIZE)
+        {
+            return batch_error(job, "bad cell size");
+        }
+        job->cell_size = a;
+        return true;
+    }
+
+    if (strcmp(command, "color") == 0)
+    {
+        BrushColors *colors = &job->brush_colors;
+        int count           = (int)SDL_arraysize(colors->colors);
+        if (sscanf(args, "%i %i %i %i", &a, &b, &c, &d) != 4 || a < 1 ||
+            a > count || a > colors->size + 1 || b < 0 || b > 255 || c < 0 ||
+            c > 255 || d < 0 || d > 255)
+        {
+            return batch_error(job, "expected color N R G B");
+        }
+        colors->colors[a - 1] = (SDL_Color){b, c, d, 255};
+        colors->size          = SDL_max(colors->size, a);
+        return true;
+    }
+
+    if (strcmp(command, "brush") == 0)
+    {
+        if (sscanf(args, "%i", &a) != 1 || a < 0 ||
+            a > job->brush_colors.size)
+        {
+            return batch_error(job, "no such color");
+        }
+        job->brush = (uint8_t)a;
+        return true;
+    }
+
+    if (!job->has_canvas)
+        return batch_error(job, "no canvas");
+    Canvas *canvas = &job->canvas;
+
+    if (strcmp(command, "point") == 0)
+    {
+        if (sscanf(args, "%i %i", &a, &b) != 2 ||
+            !canvas_contains(canvas, a, b))
+        {
+            return batch_error(job, "expected point ROW COL on the canvas");
+        }
+        history_set(&job->history, canvas, a, b, job->brush);
+        return true;
+    }
+
+    if (strcmp(command, "rect") == 0)
+    {
+        if (sscanf(args, "%i %i %i %i", &a, &b, &c, &d) != 4)
+            return batch_error(job, "expected rect ROW COL ROWS COLS");
+        CellRange range = {.row = a, .column = b, .rows = c, .columns = d};
+        selection_fill(canvas, &job->history, range, job->brush);
+        return true;
+    }
+
+    if (strcmp(command, "fill") == 0)
+    {
+        name[0]   = '\0';
+        int count = sscanf(args, "%i %i %15s", &a, &b, name);
+        if (count < 2 || !canvas_contains(canvas, a, b))
+            return batch_error(job, "expected fill ROW COL on the canvas");
+
+        FillMode mode = FILL_CONNECTED_4;
+        if (strcmp(name, "diagonal") == 0)
+            mode = FILL_CONNECTED_8;
+        else if (strcmp(name, "replace") == 0)
+            mode = FILL_REPLACE;
+        else if (name[0] != '\0')
+            return batch_error(job, "unknown fill mode");
+
+        fill(canvas, &job->history, a, b, job->brush, mode);
+        return true;
+    }
+
+    if (strcmp(command, "move") == 0)
+    {
+        if (sscanf(args, "%i %i %i %i %i %i", &a, &b, &c, &d, &e, &f) != 6)
+        {
+            return batch_error(
+                job, "expected move ROW COL ROWS COLS DOWN RIGHT"
+            );
+        }
+        CellRange range = {.row = a, .column = b, .rows = c, .columns = d};
+        selection_move(canvas, &job->history, range, e, f);
+        return true;
+    }
+
+    if (strcmp(command, "clear") == 0)
+    {
+        canvas_clear(canvas);
+        return true;
+    }
+
+    return batch_error(job, "unknown command");
+}
+
+// Image file of a project job: the project with a .png extension, in the
+// output directory if there is one
+static void batch_image_name(
+    const BatchQueue *queue, const char *file_name, char *path, size_t size
+)
+{
+    const char *slash = strrchr(file_name, '/');
+    const char *base  = queue->output != NULL && slash != NULL ? slash + 1
+                                                               : file_name;
+    int length =
+        (int)(strlen(base) - (batch_has_extension(base, PROJECT_EXTENSION)
+                                  ? strlen(PROJECT_EXTENSION)
+                                  : 0));
+
+    if (queue->output != NULL)
+        snprintf(path, size, "%s/%.*s.png", queue->output, length, base);
+    else
+        snprintf(path, size, "%.*s.png", length, base);
+}
+
+static bool batch_run_job(BatchQueue *queue, const char *file_name)
+{
+    BatchJob job = {.file_name = file_name, .cell_size = DEFAULT_CELL_SIZE};
+    brush_colors_default(&job.brush_colors);
+    job.brush = 1;
+    // Batch edits are never undone, a zero budget keeps the journal empty
+    history_init(&job.history, 0);
+
+    bool ok = true;
+    if (batch_has_extension(file_name, PROJECT_EXTENSION))
+    {
+        char image[BATCH_PATH_SIZE];
+        batch_image_name(queue, file_name, image, sizeof(image));
+        ok = batch_open(&job, file_name) &&
+             save_as_png(
+                 &job.canvas, &job.brush_colors, job.cell_size, image, NULL
+             );
+    }
+    else
+    {
+        FILE *script = fopen(file_name, "r");
+        if (script == NULL)
+        {
+            fprintf(stderr, "ERROR: Failed to open '%s'\n", file_name);
+            ok = false;
+        }
+
+        char line[2048];
+        while (ok && fgets(line, sizeof(line), script) != NULL)
+        {
+            job.line++;
+            ok = batch_command(&job, line);
+        }
+        if (script != NULL)
+            fclose(script);
+    }
+
+    history_free(&job.history);
+    if (job.has_canvas)
+        canvas_free(&job.canvas);
+
+    return ok;
+}
+
+static int batch_worker(void *data)
+{
+    BatchQueue *queue = data;
+
+    for (;;)
+    {
+        int index = atomic_fetch_add(&queue->next, 1);
+        if (index >= queue->count)
+            break;
+        if (!batch_run_job(queue, queue->files[index]))
+            atomic_fetch_add(&queue->failed, 1);
+    }
+
+    return 0;
+}
+
+int batch_main(int argc, char **argv)
+{
+    BatchQueue queue = {.files = NULL, .output = NULL};
+    atomic_init(&queue.next, 0);
+    atomic_init(&queue.failed, 0);
+    int workers = SDL_GetCPUCount();
+    bool ok     = true;
+
+    for (int i = 0; ok && i < argc; ++i)
+    {
+        struct stat st;
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            workers = atoi(argv[++i]);
+            ok      = workers > 0;
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            queue.output = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "ERROR: Unknown option '%s'\n", argv[i]);
+            ok = false;
+        }
+        else if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            ok = batch_add_directory(&queue, argv[i]);
+        }
+        else
+        {
+            ok = batch_add(&queue, argv[i]);
+        }
+    }
+
+    if (!ok || queue.count == 0)
+    {
+        batch_usage();
+        for (int i = 0; i < queue.count; ++i)
+            free(queue.files[i]);
+        free(queue.files);
+        return 1;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    // The calling thread is a worker too
+    workers = SDL_min(workers, queue.count);
+    SDL_Thread **threads =
+        workers > 1 ? malloc((workers - 1) * sizeof(SDL_Thread *)) : NULL;
+    int started = 0;
+    while (threads != NULL && started < workers - 1)
+    {
+        threads[started] = SDL_CreateThread(batch_worker, "batch", &queue);
+        if (threads[started] == NULL)
+            break;
+        started++;
+    }
+    batch_worker(&queue);
+    for (int i = 0; i < started; ++i)
+        SDL_WaitThread(threads[i], NULL);
+    free(threads);
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) /
+                     SDL_GetPerformanceFrequency();
+    int failed     = atomic_load(&queue.failed);
+    printf(
+        "Ran %i jobs on %i threads in %.3f s (%.1f jobs/s), %i failed\n",
+        queue.count,
+        started + 1,
+        seconds,
+        queue.count / seconds,
+        failed
+    );
+
+    for (int i = 0; i < queue.count; ++i)
+        free(queue.files[i]);
+    free(queue.files);
+
+    return failed > 0 ? 1 : 0;
+}
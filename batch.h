@@ -0,0 +1,14 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Extension of command scripts picked up from job directories
+#define BATCH_SCRIPT_EXTENSION ".pxs"
+
+// Headless mode, run with the arguments that follow --batch. Each job is a
+// project file, exported to a PNG image, or a command script that builds and
+// exports canvases; directories are searched for both. Jobs run in parallel
+// on worker threads. Neither SDL video nor SDL_ttf is initialized, only the
+// canvas core and libattopng are used. Returns the exit status.
+int batch_main(int argc, char **argv);
+
+#endif // BATCH_H
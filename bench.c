@@ -0,0 +1,480 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "canvas.h"
+#include "export.h"
+#include "history.h"
+#include "include/libattopng.h"
+#include "view.h"
+
+// Every benchmark repeats its operation for at least this long
+#define BENCH_MIN_NS 200000000LL
+
+// Cells written per operation by the canvas benchmarks, a tile's worth
+#define BENCH_CELLS (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+// Undo memory of the editor by default, so the journal is trimmed as in a
+// long session
+#define BENCH_HISTORY_SIZE (64 << 20)
+
+typedef void (*BenchFn)(void *ctx);
+
+typedef struct
+{
+    const unsigned char *data;
+    size_t size;
+} Buffer;
+
+// Results are written here so the compiler cannot drop the work
+static volatile uint32_t bench_sink;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Prints one JSON object per line: name, iterations, ns/op and MB/s (0 when
+// the operation has no meaningful byte count)
+static void run_bench(const char *name, BenchFn fn, void *ctx, size_t bytes)
+{
+    long long iterations = 0;
+    long long batch      = 1;
+    long long start      = now_ns();
+    long long elapsed    = 0;
+
+    while (elapsed < BENCH_MIN_NS)
+    {
+        for (long long i = 0; i < batch; ++i)
+            fn(ctx);
+        iterations += batch;
+        batch *= 2;
+        elapsed = now_ns() - start;
+    }
+
+    double ns_per_op = (double)elapsed / iterations;
+    double mb_per_s  = bytes > 0 ? bytes / ns_per_op * 1e3 : 0.0;
+
+    printf(
+        "{\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.1f, "
+        "\"mb_per_s\": %.1f}\n",
+        name,
+        iterations,
+        ns_per_op,
+        mb_per_s
+    );
+    fflush(stdout);
+}
+
+static void bench_fail(const char *what)
+{
+    fprintf(stderr, "ERROR: Failed to allocate %s\n", what);
+    exit(1);
+}
+
+// Paints `canvas` in 8x8 blocks of the first 16 brush colors, a stand-in for
+// pixel art that neither compresses away nor looks like noise
+static void bench_paint(Canvas *canvas)
+{
+    for (int row = 0; row < canvas->rows; ++row)
+    {
+        for (int col = 0; col < canvas->columns; col += 8)
+        {
+            uint8_t value = (uint8_t)((row / 8 * 7 + col / 8 * 3) % 16 + 1);
+            int length    = SDL_min(8, canvas->columns - col);
+            if (!canvas_set_run(canvas, row, col, length, value))
+                bench_fail("canvas tiles");
+        }
+    }
+    canvas_clear_dirty(canvas);
+}
+
+typedef struct
+{
+    Canvas canvas;
+    History history;
+    // Cells of canvas_set/random, as row << 16 | column
+    uint32_t *cells;
+    // Alternates so every write changes the cell
+    uint8_t value;
+} WriteBench;
+
+static void bench_canvas_set(void *ctx)
+{
+    WriteBench *bench = ctx;
+    for (int row = 0; row < CANVAS_TILE_SIZE; ++row)
+    {
+        for (int col = 0; col < CANVAS_TILE_SIZE; ++col)
+            canvas_set(&bench->canvas, row, col, bench->value);
+    }
+    bench->value = bench->value % 16 + 1;
+}
+
+static void bench_canvas_set_random(void *ctx)
+{
+    WriteBench *bench = ctx;
+    for (int i = 0; i < BENCH_CELLS; ++i)
+    {
+        uint32_t cell = bench->cells[i];
+        canvas_set(&bench->canvas, cell >> 16, cell & 0xFFFF, bench->value);
+    }
+    bench->value = bench->value % 16 + 1;
+}
+
+static void bench_canvas_set_run(void *ctx)
+{
+    WriteBench *bench = ctx;
+    for (int row = 0; row < CANVAS_TILE_SIZE; ++row)
+        canvas_set_run(&bench->canvas, row, 0, CANVAS_TILE_SIZE, bench->value);
+    bench->value = bench->value % 16 + 1;
+}
+
+// What save_point() does for each cell of a brush stroke, one undo step per
+// operation
+static void bench_save_point(void *ctx)
+{
+    WriteBench *bench = ctx;
+    history_begin(&bench->history);
+    for (int row = 0; row < CANVAS_TILE_SIZE; ++row)
+    {
+        for (int col = 0; col < CANVAS_TILE_SIZE; ++col)
+        {
+            history_set(
+                &bench->history, &bench->canvas, row, col, bench->value
+            );
+        }
+    }
+    history_end(&bench->history);
+    bench->value = bench->value % 16 + 1;
+}
+
+static void bench_canvas(void)
+{
+    WriteBench bench = {.value = 1};
+    if (!canvas_init(&bench.canvas, 4096, 4096))
+        bench_fail("canvas");
+    history_init(&bench.history, BENCH_HISTORY_SIZE);
+
+    bench.cells = malloc(BENCH_CELLS * sizeof(uint32_t));
+    if (bench.cells == NULL)
+        bench_fail("cell list");
+    for (int i = 0; i < BENCH_CELLS; ++i)
+        bench.cells[i] = (uint32_t)(rand() % 4096) << 16 | (rand() % 4096);
+
+    run_bench("canvas_set/64x64", bench_canvas_set, &bench, BENCH_CELLS);
+    run_bench(
+        "canvas_set_run/64x64", bench_canvas_set_run, &bench, BENCH_CELLS
+    );
+    run_bench(
+        "canvas_set/random4096", bench_canvas_set_random, &bench, BENCH_CELLS
+    );
+    run_bench("save_point/64x64", bench_save_point, &bench, BENCH_CELLS);
+
+    history_free(&bench.history);
+    canvas_free(&bench.canvas);
+    free(bench.cells);
+}
+
+typedef struct
+{
+    Canvas canvas;
+    BrushColors brush_colors;
+    int cell_size;
+} ExportBench;
+
+// The rasterizing half of save_as_png(), without encoding or file IO
+static void bench_export_image(void *ctx)
+{
+    ExportBench *bench = ctx;
+    libattopng_t *png =
+        export_image(&bench->canvas, &bench->brush_colors, bench->cell_size);
+    if (png == NULL)
+        bench_fail("image");
+    libattopng_destroy(png);
+}
+
+static void bench_export(void)
+{
+    static const int cell_sizes[] = {1, 4, 16};
+    char name[64];
+
+    ExportBench bench;
+    brush_colors_default(&bench.brush_colors);
+    if (!canvas_init(&bench.canvas, 256, 256))
+        bench_fail("canvas");
+    bench_paint(&bench.canvas);
+
+    for (size_t i = 0; i < sizeof(cell_sizes) / sizeof(cell_sizes[0]); ++i)
+    {
+        // Few enough colors for a palette image, one byte per pixel
+        bench.cell_size = cell_sizes[i];
+        size_t side     = (size_t)256 * cell_sizes[i];
+
+        snprintf(
+            name, sizeof(name), "export_image/256x256/cell%i", cell_sizes[i]
+        );
+        run_bench(name, bench_export_image, &bench, side * side);
+    }
+
+    canvas_free(&bench.canvas);
+}
+
+// The output stays owned by the image and is replaced by the next call
+static void bench_get_data(void *ctx)
+{
+    size_t length;
+    if (libattopng_get_data(ctx, &length) == NULL)
+        bench_fail("encoded image");
+    bench_sink = (uint32_t)length;
+}
+
+// Image of `size` by `size` pixels in 8x8 blocks, each a color of the type
+static libattopng_t *bench_image(libattopng_type_t type, size_t size)
+{
+    libattopng_t *png = libattopng_new(size, size, type);
+    if (png == NULL)
+        bench_fail("image");
+
+    uint32_t palette[16];
+    for (int i = 0; i < 16; ++i)
+        palette[i] = (uint32_t)rand() | 0xFF000000u;
+    if (type == PNG_PALETTE)
+        libattopng_set_palette(png, palette, 16);
+
+    for (size_t y = 0; y < size; y += 8)
+    {
+        for (size_t x = 0; x < size; x += 8)
+        {
+            uint32_t color = palette[(y / 8 * 7 + x / 8 * 3) % 16];
+            if (type == PNG_PALETTE)
+                color = (uint32_t)((y / 8 * 7 + x / 8 * 3) % 16);
+            else if (type == PNG_GRAYSCALE)
+                color &= 0xFF;
+            else if (type == PNG_GRAYSCALE_ALPHA)
+                color = (color & 0xFF) | 0xFF00;
+            libattopng_fill_rect(png, x, y, 8, 8, color);
+        }
+    }
+
+    return png;
+}
+
+static void bench_encode(void)
+{
+    static const struct
+    {
+        const char *name;
+        libattopng_type_t type;
+        size_t pixel_size;
+    } types[] = {
+        {"gray", PNG_GRAYSCALE, 1},
+        {"gray_alpha", PNG_GRAYSCALE_ALPHA, 2},
+        {"palette", PNG_PALETTE, 1},
+        {"rgb", PNG_RGB, 3},
+        {"rgba", PNG_RGBA, 4},
+    };
+    static const size_t sizes[] = {64, 512, 2048};
+    static const libattopng_compression_t levels[] = {
+        PNG_COMPRESSION_NONE,
+        PNG_COMPRESSION_FAST,
+        PNG_COMPRESSION_DEFAULT,
+        PNG_COMPRESSION_MAX,
+    };
+    char name[64];
+
+    // Each color type and size at the default level
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+        {
+            libattopng_t *png = bench_image(types[i].type, sizes[j]);
+            snprintf(
+                name,
+                sizeof(name),
+                "get_data/%s/%zu",
+                types[i].name,
+                sizes[j]
+            );
+            run_bench(
+                name,
+                bench_get_data,
+                png,
+                sizes[j] * sizes[j] * types[i].pixel_size
+            );
+            libattopng_destroy(png);
+        }
+    }
+
+    // Each level on the image save_as_png() writes most often
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i)
+    {
+        libattopng_t *png = bench_image(PNG_PALETTE, 2048);
+        libattopng_set_compression(png, levels[i]);
+        snprintf(
+            name, sizeof(name), "get_data/palette/2048/level%i", levels[i]
+        );
+        run_bench(name, bench_get_data, png, (size_t)2048 * 2048);
+        libattopng_destroy(png);
+    }
+}
+
+typedef struct
+{
+    Canvas canvas;
+    View view;
+    SDL_Rect area;
+    Uint32 colors[256];
+    Uint32 texels[BENCH_CELLS];
+} FrameBench;
+
+// The CPU side of draw_canvas() after the brush colors changed: every
+// visible tile is converted to texels again. Texture uploads and drawing
+// need a renderer and are left out.
+static void bench_frame(void *ctx)
+{
+    FrameBench *bench = ctx;
+
+    CellRange range;
+    if (!view_visible_cells(
+            &bench->view,
+            bench->area,
+            bench->canvas.rows,
+            bench->canvas.columns,
+            &range
+        ))
+    {
+        return;
+    }
+
+    int top    = range.row >> CANVAS_TILE_BITS;
+    int left   = range.column >> CANVAS_TILE_BITS;
+    int bottom = (range.row + range.rows - 1) >> CANVAS_TILE_BITS;
+    int right  = (range.column + range.columns - 1) >> CANVAS_TILE_BITS;
+    for (int tile_row = top; tile_row <= bottom; ++tile_row)
+    {
+        for (int tile_col = left; tile_col <= right; ++tile_col)
+        {
+            const CanvasTile *tile =
+                canvas_tile(&bench->canvas, tile_row, tile_col);
+            if (tile == NULL)
+                continue;
+
+            tile_texels(
+                tile,
+                bench->colors,
+                bench->texels,
+                CANVAS_TILE_SIZE * sizeof(Uint32)
+            );
+            SDL_Rect dst = view_cells_rect(
+                &bench->view,
+                tile_row << CANVAS_TILE_BITS,
+                tile_col << CANVAS_TILE_BITS,
+                CANVAS_TILE_SIZE,
+                CANVAS_TILE_SIZE
+            );
+            bench_sink += bench->texels[0] + dst.x;
+        }
+    }
+}
+
+static void bench_frames(void)
+{
+    static const int cell_sizes[] = {20, 4, 1};
+    char name[64];
+
+    FrameBench *bench = malloc(sizeof(FrameBench));
+    if (bench == NULL || !canvas_init(&bench->canvas, 4096, 4096))
+        bench_fail("canvas");
+    bench_paint(&bench->canvas);
+
+    BrushColors brush_colors;
+    brush_colors_default(&brush_colors);
+    brush_colors_texels(&brush_colors, bench->colors);
+    // Largest window picked at startup, less the top bar
+    bench->area = (SDL_Rect){.x = 0, .y = 80, .w = 1280, .h = 880};
+
+    for (size_t i = 0; i < sizeof(cell_sizes) / sizeof(cell_sizes[0]); ++i)
+    {
+        bench->view = view_at(bench->area.x, bench->area.y, cell_sizes[i]);
+
+        // Texel bytes of the tiles the view covers
+        CellRange range;
+        view_visible_cells(&bench->view, bench->area, 4096, 4096, &range);
+        size_t tiles =
+            (size_t)(((range.row + range.rows - 1) >> CANVAS_TILE_BITS) -
+                     (range.row >> CANVAS_TILE_BITS) + 1) *
+            (((range.column + range.columns - 1) >> CANVAS_TILE_BITS) -
+             (range.column >> CANVAS_TILE_BITS) + 1);
+
+        snprintf(name, sizeof(name), "frame/1280x880/cell%i", cell_sizes[i]);
+        run_bench(name, bench_frame, bench, tiles * sizeof(bench->texels));
+    }
+
+    canvas_free(&bench->canvas);
+    free(bench);
+}
+
+static void bench_crc32(void *ctx)
+{
+    Buffer *buffer = ctx;
+    bench_sink     = libattopng_crc32(0, buffer->data, buffer->size);
+}
+
+static void bench_adler32(void *ctx)
+{
+    Buffer *buffer = ctx;
+    bench_sink     = libattopng_adler32(1, buffer->data, buffer->size);
+}
+
+static void bench_checksums(void)
+{
+    static const size_t sizes[] = {64, 4096, 1 << 20};
+    char name[64];
+
+    unsigned char *data = malloc(sizes[2]);
+    if (data == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to allocate benchmark buffer\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < sizes[2]; ++i)
+        data[i] = (unsigned char)rand();
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        Buffer buffer = {.data = data, .size = sizes[i]};
+
+        snprintf(name, sizeof(name), "crc32/%zu", sizes[i]);
+        run_bench(name, bench_crc32, &buffer, sizes[i]);
+
+        snprintf(name, sizeof(name), "adler32/%zu", sizes[i]);
+        run_bench(name, bench_adler32, &buffer, sizes[i]);
+    }
+
+    free(data);
+}
+
+int main()
+{
+    srand(1);
+
+    // Check values from the zlib documentation
+    const unsigned char *check = (const unsigned char *)"123456789";
+    if (libattopng_crc32(0, check, 9) != 0xcbf43926 ||
+        libattopng_adler32(1, check, 9) != 0x091e01de)
+    {
+        fprintf(stderr, "ERROR: Checksum self test failed\n");
+        return 1;
+    }
+
+    bench_canvas();
+    bench_export();
+    bench_encode();
+    bench_checksums();
+    bench_frames();
+
+    return 0;
+}
@@ -0,0 +1,461 @@
+#include "canvas.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int canvas_tiles_for(int cells)
+{
+    return (cells + CANVAS_TILE_SIZE - 1) >> CANVAS_TILE_BITS;
+}
+
+static CanvasTile *canvas_tile_new(void)
+{
+    CanvasTile *tile = calloc(1, sizeof(CanvasTile));
+    if (tile != NULL)
+        atomic_init(&tile->refs, 1);
+
+    return tile;
+}
+
+static void canvas_tile_release(CanvasTile *tile)
+{
+    if (tile != NULL &&
+        atomic_fetch_sub_explicit(&tile->refs, 1, memory_order_acq_rel) == 1)
+    {
+        free(tile);
+    }
+}
+
+static CanvasData *canvas_data_new(size_t tiles)
+{
+    CanvasData *data = calloc(1, sizeof(CanvasData) + tiles * sizeof(void *));
+    if (data != NULL)
+        atomic_init(&data->refs, 1);
+
+    return data;
+}
+
+static void canvas_data_release(CanvasData *data, size_t tiles)
+{
+    if (data != NULL &&
+        atomic_fetch_sub_explicit(&data->refs, 1, memory_order_acq_rel) == 1)
+    {
+        for (size_t i = 0; i < tiles; ++i)
+            canvas_tile_release(data->tiles[i]);
+        free(data);
+    }
+}
+
+static size_t canvas_tile_count(const Canvas *canvas)
+{
+    return (size_t)canvas->tile_rows * canvas->tile_columns;
+}
+
+bool canvas_init(Canvas *canvas, int rows, int columns)
+{
+    canvas->rows         = rows;
+    canvas->columns      = columns;
+    canvas->tile_rows    = canvas_tiles_for(rows);
+    canvas->tile_columns = canvas_tiles_for(columns);
+    canvas->painted      = 0;
+    canvas->data         = canvas_data_new(canvas_tile_count(canvas));
+    // Nothing has been drawn yet, so every tile starts out dirty
+    canvas->dirty       = malloc(canvas_tile_count(canvas));
+    canvas->dirty_count = (int)canvas_tile_count(canvas);
+    if (canvas->dirty != NULL)
+        memset(canvas->dirty, true, canvas_tile_count(canvas));
+
+    return canvas->data != NULL && canvas->dirty != NULL;
+}
+
+void canvas_free(Canvas *canvas)
+{
+    canvas_data_release(canvas->data, canvas_tile_count(canvas));
+    free(canvas->dirty);
+    canvas->data         = NULL;
+    canvas->rows         = 0;
+    canvas->columns      = 0;
+    canvas->tile_rows    = 0;
+    canvas->tile_columns = 0;
+    canvas->painted      = 0;
+    canvas->dirty        = NULL;
+    canvas->dirty_count  = 0;
+}
+
+void canvas_clear(Canvas *canvas)
+{
+    size_t count = canvas_tile_count(canvas);
+
+    if (atomic_load_explicit(&canvas->data->refs, memory_order_acquire) > 1)
+    {
+        // A snapshot still reads the old table, start over with a fresh one
+        CanvasData *data = canvas_data_new(count);
+        if (data == NULL)
+            return;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (canvas->data->tiles[i] != NULL)
+                canvas_mark_dirty(canvas, (int)i);
+        }
+        canvas_data_release(canvas->data, count);
+        canvas->data = data;
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (canvas->data->tiles[i] != NULL)
+                canvas_drop_tile(canvas, (int)i);
+        }
+    }
+    canvas->painted = 0;
+}
+
+// Copy of `tile` with the cells at or past `rows` and `columns` (relative to
+// the tile) emptied. Returns NULL if out of memory or if no cell is left.
+static CanvasTile *canvas_tile_crop(
+    const CanvasTile *tile, int rows, int columns, bool *failed
+)
+{
+    CanvasTile *copy = canvas_tile_new();
+    if (copy == NULL)
+    {
+        *failed = true;
+        return NULL;
+    }
+
+    for (int row = 0; row < rows; ++row)
+    {
+        const uint8_t *from = &tile->cells[row << CANVAS_TILE_BITS];
+        memcpy(&copy->cells[row << CANVAS_TILE_BITS], from, columns);
+        for (int col = 0; col < columns; ++col)
+            copy->painted += from[col] != CANVAS_EMPTY;
+    }
+
+    if (copy->painted == 0)
+    {
+        free(copy);
+        return NULL;
+    }
+
+    return copy;
+}
+
+bool canvas_resize(Canvas *canvas, int rows, int columns)
+{
+    int tile_rows    = canvas_tiles_for(rows);
+    int tile_columns = canvas_tiles_for(columns);
+    size_t count     = (size_t)tile_rows * tile_columns;
+
+    CanvasData *data = canvas_data_new(count);
+    uint8_t *dirty   = malloc(count);
+    if (data == NULL || dirty == NULL)
+    {
+        free(data);
+        free(dirty);
+        return false;
+    }
+    memset(dirty, true, count);
+
+    int keep_rows    = tile_rows < canvas->tile_rows ? tile_rows
+                                                     : canvas->tile_rows;
+    int keep_columns = tile_columns < canvas->tile_columns
+                           ? tile_columns
+                           : canvas->tile_columns;
+    int painted      = 0;
+    bool failed      = false;
+    for (int tile_row = 0; tile_row < keep_rows; ++tile_row)
+    {
+        for (int tile_col = 0; tile_col < keep_columns; ++tile_col)
+        {
+            CanvasTile *tile =
+                canvas->data->tiles[tile_row * canvas->tile_columns + tile_col];
+            if (tile == NULL)
+                continue;
+
+            // Tiles stay aligned to cell (0, 0), so only the ones crossing
+            // the new edge need their outside cells dropped
+            int inside_rows    = rows - (tile_row << CANVAS_TILE_BITS);
+            int inside_columns = columns - (tile_col << CANVAS_TILE_BITS);
+            if (inside_rows >= CANVAS_TILE_SIZE &&
+                inside_columns >= CANVAS_TILE_SIZE)
+            {
+                atomic_fetch_add_explicit(&tile->refs, 1, memory_order_relaxed);
+            }
+            else
+            {
+                if (inside_rows > CANVAS_TILE_SIZE)
+                    inside_rows = CANVAS_TILE_SIZE;
+                if (inside_columns > CANVAS_TILE_SIZE)
+                    inside_columns = CANVAS_TILE_SIZE;
+                tile = canvas_tile_crop(
+                    tile, inside_rows, inside_columns, &failed
+                );
+                if (tile == NULL)
+                    continue;
+            }
+            data->tiles[tile_row * tile_columns + tile_col] = tile;
+            painted += tile->painted;
+        }
+    }
+
+    if (failed)
+    {
+        canvas_data_release(data, count);
+        free(dirty);
+        return false;
+    }
+
+    canvas_data_release(canvas->data, canvas_tile_count(canvas));
+    free(canvas->dirty);
+    canvas->data         = data;
+    canvas->rows         = rows;
+    canvas->columns      = columns;
+    canvas->tile_rows    = tile_rows;
+    canvas->tile_columns = tile_columns;
+    canvas->painted      = painted;
+    canvas->dirty        = dirty;
+    canvas->dirty_count  = (int)count;
+
+    return true;
+}
+
+void canvas_snapshot(const Canvas *canvas, Canvas *snapshot)
+{
+    atomic_fetch_add_explicit(&canvas->data->refs, 1, memory_order_relaxed);
+    *snapshot             = *canvas;
+    snapshot->dirty       = NULL;
+    snapshot->dirty_count = 0;
+}
+
+void canvas_restore(Canvas *canvas, const Canvas *snapshot)
+{
+    atomic_fetch_add_explicit(&snapshot->data->refs, 1, memory_order_relaxed);
+    canvas_data_release(canvas->data, canvas_tile_count(canvas));
+    canvas->data    = snapshot->data;
+    canvas->painted = snapshot->painted;
+
+    memset(canvas->dirty, true, canvas_tile_count(canvas));
+    canvas->dirty_count = (int)canvas_tile_count(canvas);
+}
+
+CanvasTile *canvas_write_tile(Canvas *canvas, int index)
+{
+    size_t count = canvas_tile_count(canvas);
+
+    if (atomic_load_explicit(&canvas->data->refs, memory_order_acquire) > 1)
+    {
+        // The table is shared with a snapshot: copy it, sharing every tile
+        CanvasData *data = canvas_data_new(count);
+        if (data == NULL)
+            return NULL;
+        for (size_t i = 0; i < count; ++i)
+        {
+            CanvasTile *tile = canvas->data->tiles[i];
+            if (tile != NULL)
+                atomic_fetch_add_explicit(&tile->refs, 1, memory_order_relaxed);
+            data->tiles[i] = tile;
+        }
+        canvas_data_release(canvas->data, count);
+        canvas->data = data;
+    }
+
+    CanvasTile *tile = canvas->data->tiles[index];
+    if (tile == NULL)
+    {
+        tile = canvas_tile_new();
+    }
+    else if (atomic_load_explicit(&tile->refs, memory_order_acquire) > 1)
+    {
+        CanvasTile *copy = canvas_tile_new();
+        if (copy == NULL)
+            return NULL;
+        memcpy(copy->cells, tile->cells, sizeof(tile->cells));
+        copy->painted = tile->painted;
+        canvas_tile_release(tile);
+        tile = copy;
+    }
+    canvas->data->tiles[index] = tile;
+
+    return tile;
+}
+
+void canvas_drop_tile(Canvas *canvas, int index)
+{
+    canvas_tile_release(canvas->data->tiles[index]);
+    canvas->data->tiles[index] = NULL;
+    canvas_mark_dirty(canvas, index);
+}
+
+bool canvas_set_run(
+    Canvas *canvas, int row, int column, int length, uint8_t value
+)
+{
+    while (length > 0)
+    {
+        int index = canvas_tile_index(canvas, row, column);
+        int count = CANVAS_TILE_SIZE - (column & CANVAS_TILE_MASK);
+        if (count > length)
+            count = length;
+
+        if (canvas->data->tiles[index] != NULL || value != CANVAS_EMPTY)
+        {
+            CanvasTile *tile = canvas_write_tile(canvas, index);
+            if (tile == NULL)
+                return false;
+
+            uint8_t *cells = &tile->cells[canvas_tile_offset(row, column)];
+            int change     = 0;
+            for (int i = 0; i < count; ++i)
+                change += (value != CANVAS_EMPTY) - (cells[i] != CANVAS_EMPTY);
+            memset(cells, value, count);
+
+            tile->painted += change;
+            canvas->painted += change;
+            canvas_mark_dirty(canvas, index);
+            if (tile->painted == 0)
+                canvas_drop_tile(canvas, index);
+        }
+
+        column += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+void canvas_read_row(
+    const Canvas *canvas, int row, int column, int length, uint8_t *cells
+)
+{
+    while (length > 0)
+    {
+        int count = CANVAS_TILE_SIZE - (column & CANVAS_TILE_MASK);
+        if (count > length)
+            count = length;
+
+        const CanvasTile *tile =
+            canvas->data->tiles[canvas_tile_index(canvas, row, column)];
+        if (tile != NULL)
+            memcpy(cells, &tile->cells[canvas_tile_offset(row, column)], count);
+        else
+            memset(cells, CANVAS_EMPTY, count);
+
+        cells += count;
+        column += count;
+        length -= count;
+    }
+}
+
+bool canvas_write_row(
+    Canvas *canvas, int row, int column, int length, const uint8_t *cells
+)
+{
+    while (length > 0)
+    {
+        int index = canvas_tile_index(canvas, row, column);
+        int count = CANVAS_TILE_SIZE - (column & CANVAS_TILE_MASK);
+        if (count > length)
+            count = length;
+
+        int painted = 0;
+        for (int i = 0; i < count; ++i)
+            painted += cells[i] != CANVAS_EMPTY;
+
+        // Empty cells need no tile
+        if (canvas->data->tiles[index] != NULL || painted > 0)
+        {
+            CanvasTile *tile = canvas_write_tile(canvas, index);
+            if (tile == NULL)
+                return false;
+
+            uint8_t *to = &tile->cells[canvas_tile_offset(row, column)];
+            for (int i = 0; i < count; ++i)
+                painted -= to[i] != CANVAS_EMPTY;
+            memcpy(to, cells, count);
+
+            tile->painted += painted;
+            canvas->painted += painted;
+            canvas_mark_dirty(canvas, index);
+            if (tile->painted == 0)
+                canvas_drop_tile(canvas, index);
+        }
+
+        cells += count;
+        column += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+int canvas_run_end(
+    const Canvas *canvas, int row, int column, int end, uint8_t value
+)
+{
+    while (column < end)
+    {
+        int stop = (column | CANVAS_TILE_MASK) + 1;
+        if (stop > end)
+            stop = end;
+
+        const CanvasTile *tile =
+            canvas->data->tiles[canvas_tile_index(canvas, row, column)];
+        if (tile == NULL)
+        {
+            if (value != CANVAS_EMPTY)
+                return column;
+            column = stop;
+            continue;
+        }
+
+        const uint8_t *cells = &tile->cells[canvas_tile_offset(row, 0)];
+        for (; column < stop; ++column)
+        {
+            if (cells[column & CANVAS_TILE_MASK] != value)
+                return column;
+        }
+    }
+
+    return end;
+}
+
+int canvas_run_start(
+    const Canvas *canvas, int row, int column, int start, uint8_t value
+)
+{
+    while (column >= start)
+    {
+        int stop = column & ~CANVAS_TILE_MASK;
+        if (stop < start)
+            stop = start;
+
+        const CanvasTile *tile =
+            canvas->data->tiles[canvas_tile_index(canvas, row, column)];
+        if (tile == NULL)
+        {
+            if (value != CANVAS_EMPTY)
+                return column + 1;
+            column = stop - 1;
+            continue;
+        }
+
+        const uint8_t *cells = &tile->cells[canvas_tile_offset(row, 0)];
+        for (; column >= stop; --column)
+        {
+            if (cells[column & CANVAS_TILE_MASK] != value)
+                return column + 1;
+        }
+    }
+
+    return start;
+}
+
+void canvas_clear_dirty(Canvas *canvas)
+{
+    if (canvas->dirty_count > 0)
+    {
+        memset(canvas->dirty, false, canvas_tile_count(canvas));
+        canvas->dirty_count = 0;
+    }
+}
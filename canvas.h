@@ -0,0 +1,201 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Value stored in a cell that has not been painted. Any other value `n`
+// refers to the brush color at index `n - 1`.
+#define CANVAS_EMPTY 0
+
+// Cells are stored in square tiles of CANVAS_TILE_SIZE cells per side. A tile
+// is only allocated once one of its cells is painted, so memory grows with
+// the painted area instead of the canvas size.
+#define CANVAS_TILE_BITS 6
+#define CANVAS_TILE_SIZE (1 << CANVAS_TILE_BITS)
+#define CANVAS_TILE_MASK (CANVAS_TILE_SIZE - 1)
+
+// Largest number of rows or columns of a canvas
+#define CANVAS_MAX_SIZE 8192
+
+typedef struct
+{
+    atomic_int refs;
+    // Number of cells that are not CANVAS_EMPTY, the tile is freed when this
+    // drops to 0
+    int painted;
+    // Row-major, one palette index per cell. Cells beyond the edge of the
+    // canvas are always CANVAS_EMPTY.
+    uint8_t cells[CANVAS_TILE_SIZE * CANVAS_TILE_SIZE];
+} CanvasTile;
+
+// Tile table, `tile_rows * tile_columns` entries with NULL for empty tiles.
+// Both the table and the tiles are shared copy-on-write between a canvas and
+// its snapshots.
+typedef struct
+{
+    atomic_int refs;
+    CanvasTile *tiles[];
+} CanvasData;
+
+// Block of cells, `rows` by `columns` starting at cell (`row`, `column`)
+typedef struct
+{
+    int row;
+    int column;
+    int rows;
+    int columns;
+} CellRange;
+
+typedef struct
+{
+    CanvasData *data;
+    int rows;
+    int columns;
+    int tile_rows;
+    int tile_columns;
+    // Number of cells that are not CANVAS_EMPTY
+    int painted;
+    // One flag per tile, set when its cells changed since the last
+    // canvas_clear_dirty(). NULL for snapshots.
+    uint8_t *dirty;
+    int dirty_count;
+} Canvas;
+
+bool canvas_init(Canvas *canvas, int rows, int columns);
+void canvas_free(Canvas *canvas);
+
+// Empties the canvas, freeing all of its tiles
+void canvas_clear(Canvas *canvas);
+
+// Changes the size of the canvas to `rows` by `columns`, keeping the cells
+// that are inside both sizes. Returns false if the new cells could not be
+// allocated, leaving the canvas unchanged.
+bool canvas_resize(Canvas *canvas, int rows, int columns);
+
+// Makes `snapshot` share the cells of `canvas` without copying them. The
+// first write to either one afterwards copies the tile table and the tile
+// written to. The snapshot is released with canvas_free() and may be read
+// from another thread.
+void canvas_snapshot(const Canvas *canvas, Canvas *snapshot);
+
+// Makes `canvas` share the cells of `snapshot` again, as if every change
+// since it was taken had been undone. Both must have the same size.
+void canvas_restore(Canvas *canvas, const Canvas *snapshot);
+
+// Returns the tile at `index` ready to be written to, allocating it or
+// making a private copy as needed. Returns NULL if out of memory.
+CanvasTile *canvas_write_tile(Canvas *canvas, int index);
+
+// Frees the tile at `index` after its last cell was emptied
+void canvas_drop_tile(Canvas *canvas, int index);
+
+// Sets `length` cells of `row` starting at `column` to `value`, a tile at a
+// time. Returns false if a tile could not be allocated.
+bool canvas_set_run(
+    Canvas *canvas, int row, int column, int length, uint8_t value
+);
+
+// Copies `length` cells of `row` starting at `column` to `cells`
+void canvas_read_row(
+    const Canvas *canvas, int row, int column, int length, uint8_t *cells
+);
+
+// Overwrites `length` cells of `row` starting at `column` with `cells`, a
+// tile at a time. Returns false if a tile could not be allocated.
+bool canvas_write_row(
+    Canvas *canvas, int row, int column, int length, const uint8_t *cells
+);
+
+// Scans `row` right from `column` for a cell that is not `value`, stopping
+// at `end`. Returns its column, or `end` if all of them are `value`. Empty
+// tiles are skipped as a whole.
+int canvas_run_end(
+    const Canvas *canvas, int row, int column, int end, uint8_t value
+);
+
+// Scans `row` left from `column` for a cell that is not `value`, stopping at
+// `start`. Returns the column after it, where the run of `value` begins.
+int canvas_run_start(
+    const Canvas *canvas, int row, int column, int start, uint8_t value
+);
+
+void canvas_clear_dirty(Canvas *canvas);
+
+static inline bool canvas_contains(const Canvas *canvas, int row, int column)
+{
+    return row >= 0 && row < canvas->rows && column >= 0 &&
+           column < canvas->columns;
+}
+
+static inline int canvas_tile_index(const Canvas *canvas, int row, int column)
+{
+    return (row >> CANVAS_TILE_BITS) * canvas->tile_columns +
+           (column >> CANVAS_TILE_BITS);
+}
+
+static inline int canvas_tile_offset(int row, int column)
+{
+    return ((row & CANVAS_TILE_MASK) << CANVAS_TILE_BITS) |
+           (column & CANVAS_TILE_MASK);
+}
+
+// Tile at tile coordinates `tile_row`, `tile_column`, NULL if it is empty
+static inline const CanvasTile *canvas_tile(
+    const Canvas *canvas, int tile_row, int tile_column
+)
+{
+    return canvas->data->tiles[tile_row * canvas->tile_columns + tile_column];
+}
+
+static inline void canvas_mark_dirty(Canvas *canvas, int index)
+{
+    if (canvas->dirty != NULL && !canvas->dirty[index])
+    {
+        canvas->dirty[index] = true;
+        canvas->dirty_count++;
+    }
+}
+
+static inline uint8_t canvas_get(const Canvas *canvas, int row, int column)
+{
+    const CanvasTile *tile =
+        canvas->data->tiles[canvas_tile_index(canvas, row, column)];
+    return tile != NULL ? tile->cells[canvas_tile_offset(row, column)]
+                        : CANVAS_EMPTY;
+}
+
+static inline void canvas_set(
+    Canvas *canvas, int row, int column, uint8_t value
+)
+{
+    int index        = canvas_tile_index(canvas, row, column);
+    int offset       = canvas_tile_offset(row, column);
+    CanvasTile *tile = canvas->data->tiles[index];
+
+    uint8_t old = tile != NULL ? tile->cells[offset] : CANVAS_EMPTY;
+    if (old == value)
+        return;
+
+    if (tile == NULL ||
+        atomic_load_explicit(&canvas->data->refs, memory_order_acquire) > 1 ||
+        atomic_load_explicit(&tile->refs, memory_order_acquire) > 1)
+    {
+        tile = canvas_write_tile(canvas, index);
+        if (tile == NULL)
+            return;
+    }
+
+    int change = (value != CANVAS_EMPTY) - (old != CANVAS_EMPTY);
+    tile->cells[offset] = value;
+    tile->painted += change;
+    canvas->painted += change;
+    canvas_mark_dirty(canvas, index);
+
+    if (tile->painted == 0)
+        canvas_drop_tile(canvas, index);
+}
+
+#endif // CANVAS_H
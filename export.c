@@ -0,0 +1,256 @@
+#include "export.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "view.h"
+
+#define ADD_COLOR(r, g, b)                                                     \
+    brush_colors->colors[brush_colors->size] = (SDL_Color){r, g, b, 255};      \
+    brush_colors->size++;
+
+void brush_colors_default(BrushColors *brush_colors)
+{
+    *brush_colors = (BrushColors){.size = 0, .selected = 0};
+
+    ADD_COLOR(255, 255, 255)
+    ADD_COLOR(101, 101, 101)
+    ADD_COLOR(20, 20, 20)
+    ADD_COLOR(243, 46, 50)
+    ADD_COLOR(243, 242, 46)
+    ADD_COLOR(105, 243, 46)
+    ADD_COLOR(46, 243, 101)
+    ADD_COLOR(46, 243, 234)
+    ADD_COLOR(46, 151, 243)
+    ADD_COLOR(46, 88, 243)
+    ADD_COLOR(52, 46, 243)
+    ADD_COLOR(77, 46, 243)
+    ADD_COLOR(134, 46, 243)
+    ADD_COLOR(193, 46, 243)
+    ADD_COLOR(243, 46, 226)
+    ADD_COLOR(243, 46, 145)
+}
+
+void brush_colors_load(BrushColors *brush_colors, const ProjectInfo *project)
+{
+    int count          = (int)SDL_arraysize(brush_colors->colors);
+    brush_colors->size = SDL_min(project->color_count, count);
+    for (int i = 0; i < brush_colors->size; ++i)
+    {
+        const uint8_t *color    = project->colors[i];
+        brush_colors->colors[i] = (SDL_Color){
+            color[0], color[1], color[2], color[3]
+        };
+    }
+    if (brush_colors->selected >= brush_colors->size)
+        brush_colors->selected = 0;
+}
+
+int build_export_palette(
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    uint32_t colors[256],
+    uint32_t palette[256],
+    uint32_t indices[256]
+)
+{
+    bool used[256] = {false};
+
+    for (int i = 0; i < 256; ++i)
+    {
+        SDL_Color color = {BACKGROUND_COLOR};
+        if (i != CANVAS_EMPTY && i <= brush_colors->size)
+            color = brush_colors->colors[i - 1];
+        colors[i] = RGBA(color.r, color.g, color.b, color.a);
+    }
+
+    for (int tile_row = 0; tile_row < canvas->tile_rows; ++tile_row)
+    {
+        for (int tile_col = 0; tile_col < canvas->tile_columns; ++tile_col)
+        {
+            const CanvasTile *tile = canvas_tile(canvas, tile_row, tile_col);
+            if (tile == NULL)
+                continue;
+            for (int i = 0; i < CANVAS_TILE_SIZE * CANVAS_TILE_SIZE; ++i)
+                used[tile->cells[i]] = true;
+        }
+    }
+    // Tiles also hold empty cells past the canvas edge, count the real ones
+    used[CANVAS_EMPTY] =
+        canvas->painted < (int64_t)canvas->rows * canvas->columns;
+
+    int palette_size = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        if (!used[i])
+            continue;
+
+        // Different brush slots may hold the same color
+        int entry = 0;
+        while (entry < palette_size && palette[entry] != colors[i])
+            entry++;
+
+        if (entry == palette_size)
+        {
+            if (palette_size == 256)
+                return -1;
+            palette[palette_size++] = colors[i];
+        }
+        indices[i] = entry;
+    }
+
+    return palette_size;
+}
+
+void brush_colors_texels(const BrushColors *brush_colors, Uint32 colors[256])
+{
+    memset(colors, 0, 256 * sizeof(Uint32));
+    for (int i = 1; i <= brush_colors->size; ++i)
+    {
+        SDL_Color color = brush_colors->colors[i - 1];
+        colors[i]       = RGBA(color.r, color.g, color.b, color.a);
+    }
+}
+
+void tile_texels(
+    const CanvasTile *tile, const Uint32 colors[256], void *pixels, int pitch
+)
+{
+    for (int row = 0; row < CANVAS_TILE_SIZE; ++row)
+    {
+        Uint32 *texels     = (Uint32 *)((Uint8 *)pixels + row * pitch);
+        const uint8_t *src = &tile->cells[row << CANVAS_TILE_BITS];
+        for (int col = 0; col < CANVAS_TILE_SIZE; ++col)
+            texels[col] = colors[src[col]];
+    }
+}
+
+libattopng_t *export_image(
+    Canvas *canvas, BrushColors *brush_colors, int cell_size
+)
+{
+    // Color of every canvas value, and what gets written to the image for it
+    uint32_t colors[256];
+    uint32_t pixels[256];
+    uint32_t palette[256];
+    int palette_size = build_export_palette(
+        canvas, brush_colors, colors, palette, pixels
+    );
+    if (palette_size < 0)
+        memcpy(pixels, colors, sizeof(pixels));
+
+    // The image shows the canvas as seen through a view at its origin
+    View view = view_at(0, 0, cell_size);
+    SDL_Rect image =
+        view_cells_rect(&view, 0, 0, canvas->rows, canvas->columns);
+    int width  = image.w;
+    int height = image.h;
+
+    libattopng_t *png = libattopng_new(
+        width, height, palette_size < 0 ? PNG_RGBA : PNG_PALETTE
+    );
+    if (png == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to allocate image\n");
+        return NULL;
+    }
+    if (palette_size >= 0)
+        libattopng_set_palette(png, palette, palette_size);
+
+    // New images are all zero, only fill in the background if that is not
+    // what empty cells map to
+    if (pixels[CANVAS_EMPTY] != 0)
+        libattopng_fill_rect(png, 0, 0, width, height, pixels[CANVAS_EMPTY]);
+
+    // Each run of equal painted cells in a tile row becomes one rectangle,
+    // and empty tiles are skipped entirely
+    for (int tile_row = 0; tile_row < canvas->tile_rows; ++tile_row)
+    {
+        for (int tile_col = 0; tile_col < canvas->tile_columns; ++tile_col)
+        {
+            const CanvasTile *tile = canvas_tile(canvas, tile_row, tile_col);
+            if (tile == NULL)
+                continue;
+
+            int top    = tile_row << CANVAS_TILE_BITS;
+            int left   = tile_col << CANVAS_TILE_BITS;
+            int bottom = SDL_min(top + CANVAS_TILE_SIZE, canvas->rows);
+            int right  = SDL_min(left + CANVAS_TILE_SIZE, canvas->columns);
+            for (int row = top; row < bottom; ++row)
+            {
+                const uint8_t *cells = &tile->cells[canvas_tile_offset(row, 0)];
+                int col              = left;
+                while (col < right)
+                {
+                    uint8_t value = cells[col - left];
+                    int run       = 1;
+                    while (col + run < right &&
+                           cells[col + run - left] == value)
+                    {
+                        run++;
+                    }
+
+                    if (value != CANVAS_EMPTY)
+                    {
+                        SDL_Rect rect =
+                            view_cells_rect(&view, row, col, 1, run);
+                        libattopng_fill_rect(
+                            png, rect.x, rect.y, rect.w, rect.h, pixels[value]
+                        );
+                    }
+
+                    col += run;
+                }
+            }
+        }
+    }
+
+    return png;
+}
+
+static void save_progress(void *data, size_t line, size_t height)
+{
+    atomic_store((atomic_int *)data, (int)(line * 100 / height));
+}
+
+bool save_as_png(
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    int cell_size,
+    const char *file_name,
+    atomic_int *progress
+)
+{
+    printf("Saving image to '%s'\n", file_name);
+
+    libattopng_t *png = export_image(canvas, brush_colors, cell_size);
+    if (png == NULL)
+        return false;
+
+    if (progress != NULL)
+        libattopng_set_progress(png, save_progress, progress);
+
+    int error = libattopng_save(png, file_name);
+    libattopng_destroy(png);
+
+    if (error)
+        fprintf(stderr, "ERROR: Failed to save image to '%s'\n", file_name);
+
+    return !error;
+}
+
+void project_info(
+    BrushColors *brush_colors, int cell_size, ProjectInfo *project
+)
+{
+    project->cell_size   = cell_size;
+    project->color_count = brush_colors->size;
+    for (int i = 0; i < brush_colors->size; ++i)
+    {
+        SDL_Color color       = brush_colors->colors[i];
+        project->colors[i][0] = color.r;
+        project->colors[i][1] = color.g;
+        project->colors[i][2] = color.b;
+        project->colors[i][3] = color.a;
+    }
+}
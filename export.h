@@ -0,0 +1,83 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canvas.h"
+#include "include/libattopng.h"
+#include "project.h"
+
+#define RGBA(r, g, b, a)                                                       \
+    ((Uint32)(r) | ((Uint32)(g) << 8) | ((Uint32)(b) << 16) |                  \
+     ((Uint32)(a) << 24))
+
+#define BACKGROUND_COLOR 28, 28, 28, 255
+
+// Pixels per cell in exported images, and on screen at a zoom of 1x
+#define DEFAULT_CELL_SIZE 20
+#define MIN_CELL_SIZE     1
+#define MAX_CELL_SIZE     64
+
+typedef struct
+{
+    SDL_Color colors[99];
+    int size;
+    int selected;
+} BrushColors;
+
+// The colors a new canvas starts with
+void brush_colors_default(BrushColors *brush_colors);
+
+// Replaces the colors with the ones of a project, as many as fit
+void brush_colors_load(BrushColors *brush_colors, const ProjectInfo *project);
+
+// Colors and cell size as stored in a project file
+void project_info(
+    BrushColors *brush_colors, int cell_size, ProjectInfo *project
+);
+
+// Fills `colors` with the RGBA color of every canvas value and builds a
+// palette from the distinct colors the canvas actually uses, writing the
+// palette index of each used value to `indices`. Returns the palette size, or
+// -1 when more than 256 distinct colors are in use and the image has to be
+// stored as RGBA.
+int build_export_palette(
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    uint32_t colors[256],
+    uint32_t palette[256],
+    uint32_t indices[256]
+);
+
+// Fills `colors` with the packed RGBA() texel of every canvas value, with
+// empty cells transparent
+void brush_colors_texels(const BrushColors *brush_colors, Uint32 colors[256]);
+
+// Writes the cells of `tile` to `pixels` as texels of `colors`, with rows
+// `pitch` bytes apart
+void tile_texels(
+    const CanvasTile *tile, const Uint32 colors[256], void *pixels, int pitch
+);
+
+// Rasterizes the canvas with `cell_size` pixels per cell into a new image,
+// not encoded yet. Returns NULL if it could not be allocated.
+libattopng_t *export_image(
+    Canvas *canvas, BrushColors *brush_colors, int cell_size
+);
+
+// Writes the canvas to `file_name` with `cell_size` pixels per cell, storing
+// the percentage done in `progress` (may be NULL) while encoding. Returns
+// false if the image could not be written. Only the canvas and libattopng
+// are used, no SDL subsystem has to be initialized.
+bool save_as_png(
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    int cell_size,
+    const char *file_name,
+    atomic_int *progress
+);
+
+#endif // EXPORT_H
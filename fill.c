@@ -0,0 +1,186 @@
+#include "fill.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    int row;
+    int column;
+} FillSeed;
+
+// Cells still to be filled from, kept on the heap rather than the call stack
+// so that large regions cannot overflow it
+typedef struct
+{
+    FillSeed *seeds;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} FillStack;
+
+static void fill_push(FillStack *stack, int row, int column)
+{
+    if (stack->count == stack->capacity)
+    {
+        size_t capacity = stack->capacity > 0 ? stack->capacity * 2 : 256;
+        FillSeed *seeds = realloc(stack->seeds, capacity * sizeof(FillSeed));
+        if (seeds == NULL)
+        {
+            stack->failed = true;
+            return;
+        }
+        stack->seeds    = seeds;
+        stack->capacity = capacity;
+    }
+
+    stack->seeds[stack->count++] = (FillSeed){.row = row, .column = column};
+}
+
+// Pushes one seed for each run of `target` cells in `row` between `left` and
+// `right`
+static void fill_scan(
+    const Canvas *canvas,
+    FillStack *stack,
+    int row,
+    int left,
+    int right,
+    uint8_t target
+)
+{
+    // Whole runs are skipped at once, both of `target` and of other values,
+    // which is what already filled rows are made of
+    int col = left;
+    while (col <= right)
+    {
+        uint8_t value = canvas_get(canvas, row, col);
+        if (value == target)
+            fill_push(stack, row, col);
+        col = canvas_run_end(canvas, row, col + 1, right + 1, value);
+    }
+}
+
+// Scanline fill: each seed grows into the whole span of `target` cells
+// around it, which is filled at once, and the rows above and below the span
+// are scanned for seeds
+static long fill_region(
+    Canvas *canvas,
+    History *history,
+    int row,
+    int column,
+    uint8_t target,
+    uint8_t value,
+    bool diagonal
+)
+{
+    FillStack stack = {.seeds = NULL};
+    long filled     = 0;
+
+    fill_push(&stack, row, column);
+    while (stack.count > 0 && !stack.failed)
+    {
+        FillSeed seed = stack.seeds[--stack.count];
+        if (canvas_get(canvas, seed.row, seed.column) != target)
+            continue;
+
+        int left  = canvas_run_start(canvas, seed.row, seed.column, 0, target);
+        int right = canvas_run_end(
+                        canvas, seed.row, seed.column, canvas->columns, target
+                    ) -
+                    1;
+
+        history_set_run(
+            history, canvas, seed.row, left, right - left + 1, value
+        );
+        if (canvas_get(canvas, seed.row, left) != value)
+            break;
+        filled += right - left + 1;
+
+        if (diagonal)
+        {
+            left  = left > 0 ? left - 1 : left;
+            right = right < canvas->columns - 1 ? right + 1 : right;
+        }
+        if (seed.row > 0)
+            fill_scan(canvas, &stack, seed.row - 1, left, right, target);
+        if (seed.row < canvas->rows - 1)
+            fill_scan(canvas, &stack, seed.row + 1, left, right, target);
+    }
+
+    free(stack.seeds);
+    return filled;
+}
+
+// Replaces every `target` cell. Unless empty cells are replaced, only the
+// resident tiles are visited.
+static long fill_replace(
+    Canvas *canvas, History *history, uint8_t target, uint8_t value
+)
+{
+    long filled = 0;
+
+    for (int tile_row = 0; tile_row < canvas->tile_rows; ++tile_row)
+    {
+        for (int tile_col = 0; tile_col < canvas->tile_columns; ++tile_col)
+        {
+            int top    = tile_row << CANVAS_TILE_BITS;
+            int left   = tile_col << CANVAS_TILE_BITS;
+            int bottom = top + CANVAS_TILE_SIZE;
+            int right  = left + CANVAS_TILE_SIZE;
+            if (bottom > canvas->rows)
+                bottom = canvas->rows;
+            if (right > canvas->columns)
+                right = canvas->columns;
+
+            for (int row = top; row < bottom; ++row)
+            {
+                // Looked up again for every row, replacing the last painted
+                // cells frees the tile
+                const CanvasTile *tile =
+                    canvas_tile(canvas, tile_row, tile_col);
+                if (tile == NULL && target != CANVAS_EMPTY)
+                    break;
+
+                int col = left;
+                while (col < right)
+                {
+                    int run =
+                        canvas_run_end(canvas, row, col, right, target) - col;
+                    if (run > 0)
+                    {
+                        history_set_run(history, canvas, row, col, run, value);
+                        filled += run;
+                        col += run;
+                    }
+                    else
+                    {
+                        col++;
+                    }
+                }
+            }
+        }
+    }
+
+    return filled;
+}
+
+long fill(
+    Canvas *canvas,
+    History *history,
+    int row,
+    int column,
+    uint8_t value,
+    FillMode mode
+)
+{
+    uint8_t target = canvas_get(canvas, row, column);
+    if (target == value)
+        return 0;
+
+    if (mode == FILL_REPLACE)
+        return fill_replace(canvas, history, target, value);
+
+    return fill_region(
+        canvas, history, row, column, target, value, mode == FILL_CONNECTED_8
+    );
+}
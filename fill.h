@@ -0,0 +1,32 @@
+#ifndef FILL_H
+#define FILL_H
+
+#include <stdint.h>
+
+#include "canvas.h"
+#include "history.h"
+
+typedef enum
+{
+    // Cells sharing an edge with the region
+    FILL_CONNECTED_4,
+    // Cells sharing an edge or a corner with the region
+    FILL_CONNECTED_8,
+    // Every cell of the same value anywhere on the canvas
+    FILL_REPLACE,
+} FillMode;
+
+// Bucket fill: sets the cell at `row`, `column` and every cell of the same
+// value reachable from it (or all of them, for FILL_REPLACE) to `value`.
+// Changes are recorded in the open history entry. Returns the number of
+// cells changed.
+long fill(
+    Canvas *canvas,
+    History *history,
+    int row,
+    int column,
+    uint8_t value,
+    FillMode mode
+);
+
+#endif // FILL_H
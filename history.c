@@ -0,0 +1,381 @@
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static size_t history_entry_memory(const HistoryEntry *entry)
+{
+    size_t memory =
+        sizeof(HistoryEntry) + entry->capacity * sizeof(HistoryDelta);
+
+    if (entry->kind == HISTORY_CLEAR)
+    {
+        // The snapshot keeps the cleared tiles alive
+        const Canvas *canvas = &entry->snapshot;
+        memory += (size_t)canvas->tile_rows * canvas->tile_columns *
+                  sizeof(CanvasTile *);
+        for (int i = 0; i < canvas->tile_rows * canvas->tile_columns; ++i)
+        {
+            if (canvas->data->tiles[i] != NULL)
+                memory += sizeof(CanvasTile);
+        }
+    }
+
+    return memory;
+}
+
+static void history_entry_free(History *history, HistoryEntry *entry)
+{
+    history->memory -= history_entry_memory(entry);
+    free(entry->deltas);
+    if (entry->kind == HISTORY_CLEAR)
+        canvas_free(&entry->snapshot);
+}
+
+// Removes `count` entries starting at `first`
+static void history_remove(History *history, int first, int count)
+{
+    // An empty journal may have no entries allocated yet
+    if (count == 0)
+        return;
+
+    for (int i = first; i < first + count; ++i)
+        history_entry_free(history, &history->entries[i]);
+
+    memmove(
+        &history->entries[first],
+        &history->entries[first + count],
+        (history->count - first - count) * sizeof(HistoryEntry)
+    );
+    history->count -= count;
+    if (history->current > first)
+        history->current -= history->current < first + count
+                                ? history->current - first
+                                : count;
+}
+
+// Drops entries until the journal fits its budget: first the ones that could
+// be redone, then the oldest ones. The open entry is kept unless it outgrew
+// the budget by itself, in which case nothing before it can be undone either.
+static void history_trim(History *history)
+{
+    while (history->memory > history->budget &&
+           history->count > history->current)
+    {
+        history_remove(history, history->count - 1, 1);
+    }
+
+    int keep = history->open ? 1 : 0;
+    while (history->memory > history->budget && history->count > keep)
+        history_remove(history, 0, 1);
+
+    if (history->memory > history->budget && history->count > 0)
+    {
+        history_remove(history, 0, history->count);
+        history->overflow = history->open;
+    }
+}
+
+static HistoryEntry *history_push(History *history, HistoryKind kind)
+{
+    history_end(history);
+
+    // New changes replace whatever could be redone
+    if (history->count > history->current)
+    {
+        history_remove(
+            history, history->current, history->count - history->current
+        );
+    }
+
+    if (history->count == history->capacity)
+    {
+        int capacity = history->capacity > 0 ? history->capacity * 2 : 64;
+        HistoryEntry *entries =
+            realloc(history->entries, capacity * sizeof(HistoryEntry));
+        if (entries == NULL)
+            return NULL;
+        history->entries  = entries;
+        history->capacity = capacity;
+    }
+
+    HistoryEntry *entry = &history->entries[history->count++];
+    *entry              = (HistoryEntry){.kind = kind};
+    history->current    = history->count;
+    history->memory += history_entry_memory(entry);
+
+    return entry;
+}
+
+void history_init(History *history, size_t budget)
+{
+    *history = (History){.budget = budget};
+}
+
+void history_free(History *history)
+{
+    history_clear(history);
+    free(history->entries);
+    *history = (History){.budget = history->budget};
+}
+
+void history_clear(History *history)
+{
+    history_remove(history, 0, history->count);
+    history->open     = false;
+    history->overflow = false;
+}
+
+void history_begin(History *history)
+{
+    history->open = history_push(history, HISTORY_EDIT) != NULL;
+
+    // Entries that cannot be undone must not be followed by older ones
+    if (!history->open)
+        history_clear(history);
+}
+
+void history_end(History *history)
+{
+    HistoryEntry *entry = history->open && history->current > 0
+                              ? &history->entries[history->current - 1]
+                              : NULL;
+
+    if (entry != NULL && entry->count == 0)
+    {
+        // Nothing changed, do not leave an empty step behind
+        history_remove(history, history->current - 1, 1);
+    }
+    else if (entry != NULL && entry->count < entry->capacity)
+    {
+        // The entry is final, give back the room left for more deltas
+        HistoryDelta *deltas =
+            realloc(entry->deltas, entry->count * sizeof(HistoryDelta));
+        if (deltas != NULL)
+        {
+            history->memory -=
+                (entry->capacity - entry->count) * sizeof(HistoryDelta);
+            entry->deltas   = deltas;
+            entry->capacity = entry->count;
+        }
+    }
+    history->open     = false;
+    history->overflow = false;
+}
+
+// Appends a delta to the open entry, or grows the last one when `delta`
+// continues it. Returns false if it could not be stored.
+static bool history_record(History *history, HistoryDelta delta)
+{
+    HistoryEntry *entry = &history->entries[history->current - 1];
+
+    if (entry->count > 0)
+    {
+        // Horizontal strokes and fills come in as neighbouring cells
+        HistoryDelta *last = &entry->deltas[entry->count - 1];
+        if (last->row == delta.row &&
+            last->column + last->length == delta.column &&
+            last->before == delta.before && last->after == delta.after &&
+            last->length + delta.length <= UINT16_MAX)
+        {
+            last->length += delta.length;
+            return true;
+        }
+    }
+
+    if (entry->count == entry->capacity)
+    {
+        size_t capacity = entry->capacity > 0 ? entry->capacity * 2 : 256;
+        HistoryDelta *deltas =
+            realloc(entry->deltas, capacity * sizeof(HistoryDelta));
+        if (deltas == NULL)
+            return false;
+        history->memory += (capacity - entry->capacity) * sizeof(HistoryDelta);
+        entry->deltas   = deltas;
+        entry->capacity = capacity;
+        history_trim(history);
+        if (history->overflow)
+            return false;
+        entry = &history->entries[history->current - 1];
+    }
+
+    entry->deltas[entry->count++] = delta;
+    return true;
+}
+
+// Records a change that was already made to the canvas, opening an entry if
+// none is
+static void history_note(
+    History *history,
+    int row,
+    int column,
+    int length,
+    uint8_t before,
+    uint8_t after
+)
+{
+    if (!history->open && !history->overflow)
+        history_begin(history);
+    if (!history->open || history->overflow)
+        return;
+
+    HistoryDelta delta = {
+        .row    = (uint16_t)row,
+        .column = (uint16_t)column,
+        .length = (uint16_t)length,
+        .before = before,
+        .after  = after
+    };
+    if (!history_record(history, delta) && !history->overflow)
+    {
+        // Out of memory: the change cannot be undone, and neither can
+        // anything before it
+        history_clear(history);
+    }
+}
+
+void history_set_run(
+    History *history,
+    Canvas *canvas,
+    int row,
+    int column,
+    int length,
+    uint8_t value
+)
+{
+    int end = column + length;
+    while (column < end)
+    {
+        uint8_t before = canvas_get(canvas, row, column);
+        int run = canvas_run_end(canvas, row, column + 1, end, before) - column;
+
+        if (before != value && canvas_set_run(canvas, row, column, run, value))
+            history_note(history, row, column, run, before, value);
+
+        column += run;
+    }
+}
+
+void history_set_cells(
+    History *history,
+    Canvas *canvas,
+    int row,
+    int column,
+    int length,
+    const uint8_t *cells
+)
+{
+    uint8_t before[CANVAS_TILE_SIZE];
+
+    while (length > 0)
+    {
+        int count = length < CANVAS_TILE_SIZE ? length : CANVAS_TILE_SIZE;
+        canvas_read_row(canvas, row, column, count, before);
+        if (!canvas_write_row(canvas, row, column, count, cells))
+        {
+            // Part of the row may have changed without being recorded
+            history_clear(history);
+            return;
+        }
+
+        int i = 0;
+        while (i < count)
+        {
+            int run = 1;
+            while (i + run < count && before[i + run] == before[i] &&
+                   cells[i + run] == cells[i])
+            {
+                run++;
+            }
+            if (before[i] != cells[i])
+            {
+                history_note(
+                    history, row, column + i, run, before[i], cells[i]
+                );
+            }
+            i += run;
+        }
+
+        cells += count;
+        column += count;
+        length -= count;
+    }
+}
+
+void history_set(
+    History *history, Canvas *canvas, int row, int column, uint8_t value
+)
+{
+    history_set_run(history, canvas, row, column, 1, value);
+}
+
+void history_clear_canvas(History *history, Canvas *canvas)
+{
+    if (canvas->painted == 0)
+        return;
+
+    HistoryEntry *entry = history_push(history, HISTORY_CLEAR);
+    if (entry != NULL)
+    {
+        history->memory -= history_entry_memory(entry);
+        canvas_snapshot(canvas, &entry->snapshot);
+        history->memory += history_entry_memory(entry);
+    }
+    canvas_clear(canvas);
+
+    if (entry != NULL)
+        history_trim(history);
+    else
+        history_clear(history);
+}
+
+static void history_apply(
+    const HistoryEntry *entry, Canvas *canvas, bool forward
+)
+{
+    if (entry->kind == HISTORY_CLEAR)
+    {
+        if (forward)
+            canvas_clear(canvas);
+        else
+            canvas_restore(canvas, &entry->snapshot);
+        return;
+    }
+
+    for (size_t i = 0; i < entry->count; ++i)
+    {
+        const HistoryDelta *delta =
+            &entry->deltas[forward ? i : entry->count - 1 - i];
+        canvas_set_run(
+            canvas,
+            delta->row,
+            delta->column,
+            delta->length,
+            forward ? delta->after : delta->before
+        );
+    }
+}
+
+bool history_undo(History *history, Canvas *canvas)
+{
+    history_end(history);
+    if (history->current == 0)
+        return false;
+
+    history->current--;
+    history_apply(&history->entries[history->current], canvas, false);
+
+    return true;
+}
+
+bool history_redo(History *history, Canvas *canvas)
+{
+    history_end(history);
+    if (history->current == history->count)
+        return false;
+
+    history_apply(&history->entries[history->current], canvas, true);
+    history->current++;
+
+    return true;
+}
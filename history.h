@@ -0,0 +1,105 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canvas.h"
+
+// Run of `length` cells in a row that all changed from `before` to `after`.
+// Canvas sizes are at most 8192 cells, so 16 bits are enough.
+typedef struct
+{
+    uint16_t row;
+    uint16_t column;
+    uint16_t length;
+    uint8_t before;
+    uint8_t after;
+} HistoryDelta;
+
+typedef enum
+{
+    // Runs of cells changed in place, undone by replaying `deltas` backwards
+    HISTORY_EDIT,
+    // The whole canvas was cleared, undone by restoring `snapshot`
+    HISTORY_CLEAR,
+} HistoryKind;
+
+typedef struct
+{
+    HistoryKind kind;
+    HistoryDelta *deltas;
+    size_t count;
+    size_t capacity;
+    Canvas snapshot;
+} HistoryEntry;
+
+// Undo and redo journal. Every stroke (or other edit) is one entry holding
+// only the cells it changed, so undoing it costs time in proportion to the
+// stroke rather than the canvas. The oldest entries are dropped to keep the
+// journal within its memory budget.
+typedef struct
+{
+    HistoryEntry *entries;
+    int count;
+    int capacity;
+    // Entries before this one are applied, the ones after it can be redone
+    int current;
+    // Whether the last applied entry still takes new cells
+    bool open;
+    // Set when the open entry alone outgrew the budget and stopped recording
+    bool overflow;
+    size_t memory;
+    size_t budget;
+} History;
+
+void history_init(History *history, size_t budget);
+void history_free(History *history);
+
+// Forgets all entries, for edits that cannot be undone such as resizing
+void history_clear(History *history);
+
+// Starts a new entry that collects the changes made by history_set() until
+// the next call to history_begin() or history_end(). Drops the entries that
+// could be redone.
+void history_begin(History *history);
+void history_end(History *history);
+
+// Sets a cell of `canvas`, recording the change in the open entry
+void history_set(
+    History *history, Canvas *canvas, int row, int column, uint8_t value
+);
+
+// Sets `length` cells of `row` starting at `column`, recording one delta per
+// run of cells that had the same value
+void history_set_run(
+    History *history,
+    Canvas *canvas,
+    int row,
+    int column,
+    int length,
+    uint8_t value
+);
+
+// Overwrites `length` cells of `row` starting at `column` with `cells`,
+// recording one delta per run of cells that changed the same way
+void history_set_cells(
+    History *history,
+    Canvas *canvas,
+    int row,
+    int column,
+    int length,
+    const uint8_t *cells
+);
+
+// Clears `canvas` as a single entry. The cells are kept by a copy-on-write
+// snapshot rather than one delta per cell.
+void history_clear_canvas(History *history, Canvas *canvas);
+
+// Reverts or reapplies one entry. Return false if there is nothing to undo
+// or redo.
+bool history_undo(History *history, Canvas *canvas);
+bool history_redo(History *history, Canvas *canvas);
+
+#endif // HISTORY_H
@@ -0,0 +1,152 @@
+#include "import.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Nearest color lookups are remembered in a table of this many entries, as
+// images tend to reuse a few colors over and over
+#define IMPORT_CACHE_BITS 12
+#define IMPORT_CACHE_SIZE (1 << IMPORT_CACHE_BITS)
+
+typedef struct
+{
+    const uint8_t (*colors)[4];
+    int count;
+    // 1 << 24 | RGB of each remembered color, 0 for none
+    uint32_t keys[IMPORT_CACHE_SIZE];
+    uint8_t values[IMPORT_CACHE_SIZE];
+} ImportPalette;
+
+// Sums over the pixels of the cells of one row, with the colors weighted by
+// alpha
+typedef struct
+{
+    uint64_t red;
+    uint64_t green;
+    uint64_t blue;
+    uint64_t alpha;
+} ImportSum;
+
+// Cell value of the color nearest to `red`, `green`, `blue`
+static uint8_t import_nearest(
+    ImportPalette *palette, uint32_t red, uint32_t green, uint32_t blue
+)
+{
+    uint32_t key  = 1u << 24 | red << 16 | green << 8 | blue;
+    uint32_t slot = (key * 2654435761u) >> (32 - IMPORT_CACHE_BITS);
+    if (palette->keys[slot] == key)
+        return palette->values[slot];
+
+    uint8_t value = CANVAS_EMPTY;
+    long best     = LONG_MAX;
+    for (int i = 0; i < palette->count; ++i)
+    {
+        const uint8_t *color = palette->colors[i];
+        long dr              = (long)red - color[0];
+        long dg              = (long)green - color[1];
+        long db              = (long)blue - color[2];
+        long distance        = dr * dr + dg * dg + db * db;
+        if (distance < best)
+        {
+            best  = distance;
+            value = (uint8_t)(i + 1);
+        }
+    }
+
+    palette->keys[slot]   = key;
+    palette->values[slot] = value;
+    return value;
+}
+
+bool import_png(
+    Canvas *canvas,
+    History *history,
+    PngReader *reader,
+    const uint8_t (*colors)[4],
+    int color_count,
+    int block
+)
+{
+    int width   = reader->width;
+    int columns = (width + block - 1) / block;
+    int rows    = (reader->height + block - 1) / block;
+    if (columns > canvas->columns)
+        columns = canvas->columns;
+    if (rows > canvas->rows)
+        rows = canvas->rows;
+    // Pixels right of the last cell that fits are not needed
+    int used_width = columns * block < width ? columns * block : width;
+
+    ImportPalette *palette = calloc(1, sizeof(ImportPalette));
+    uint8_t *rgba          = malloc((size_t)width * 4);
+    ImportSum *sums        = calloc(columns, sizeof(ImportSum));
+    uint8_t *cells         = malloc(columns);
+    bool ok = palette != NULL && rgba != NULL && sums != NULL && cells != NULL;
+    if (!ok)
+        fprintf(stderr, "ERROR: Failed to allocate image import buffers\n");
+
+    if (ok)
+    {
+        palette->colors = colors;
+        palette->count  = color_count;
+    }
+
+    for (int row = 0; ok && row < rows; ++row)
+    {
+        // Source rows of this row of cells, fewer for the last one
+        int pixel_rows = reader->height - row * block;
+        if (pixel_rows > block)
+            pixel_rows = block;
+
+        for (int y = 0; y < pixel_rows && ok; ++y)
+        {
+            ok = png_read_row(reader, rgba);
+            for (int x = 0; ok && x < used_width; ++x)
+            {
+                const uint8_t *pixel = &rgba[x * 4];
+                ImportSum *sum       = &sums[x / block];
+                sum->red += pixel[0] * pixel[3];
+                sum->green += pixel[1] * pixel[3];
+                sum->blue += pixel[2] * pixel[3];
+                sum->alpha += pixel[3];
+            }
+        }
+        if (!ok)
+            break;
+
+        for (int col = 0; col < columns; ++col)
+        {
+            ImportSum *sum = &sums[col];
+            int pixel_cols = width - col * block;
+            if (pixel_cols > block)
+                pixel_cols = block;
+
+            uint64_t pixels = (uint64_t)pixel_rows * pixel_cols;
+            if (sum->alpha * 2 < pixels * 255)
+            {
+                cells[col] = CANVAS_EMPTY;
+            }
+            else
+            {
+                cells[col] = import_nearest(
+                    palette,
+                    (uint32_t)(sum->red / sum->alpha),
+                    (uint32_t)(sum->green / sum->alpha),
+                    (uint32_t)(sum->blue / sum->alpha)
+                );
+            }
+            *sum = (ImportSum){0};
+        }
+
+        history_set_cells(history, canvas, row, 0, columns, cells);
+    }
+
+    free(palette);
+    free(rgba);
+    free(sums);
+    free(cells);
+
+    return ok;
+}
@@ -0,0 +1,31 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canvas.h"
+#include "history.h"
+#include "png.h"
+
+// Largest block of image pixels imported into one cell
+#define IMPORT_MAX_BLOCK 256
+
+// Paints the image being read by `reader` onto `canvas` from its top left
+// corner, one cell for each `block` by `block` pixels, and records the change
+// in the open history entry. A cell takes the color among the `color_count`
+// RGBA `colors` nearest to the average of its pixels, or is left empty if
+// they are mostly transparent. Rows are painted as they are decoded, so only
+// one row of pixels is held at a time. Pixels beyond the canvas are dropped.
+// Returns false if the image could not be decoded, keeping the rows painted
+// before the error.
+bool import_png(
+    Canvas *canvas,
+    History *history,
+    PngReader *reader,
+    const uint8_t (*colors)[4],
+    int color_count,
+    int block
+);
+
+#endif // IMPORT_H
@@ -1,8 +1,9 @@
 /**
  * @file libattopng.h
- * @brief A minimal C library to write uncompressed PNG files.
+ * @brief A minimal C library to write PNG files.
  *
- * libattopng is a minimal C library to create uncompressed PNG images.
+ * libattopng is a minimal C library to create PNG images. The image data is
+ * compressed with a built-in DEFLATE encoder.
  * It is cross-platform compatible, has no dependencies and a very small footprint.
  * The library supports palette, grayscale as well as raw RGB images all with and without transparency.
  *
@@ -34,6 +35,37 @@ typedef enum {
 } libattopng_type_t;
 
 
+/**
+ * @brief Compression level.
+ *
+ * Trades encoding speed against file size. The values match the zlib levels.
+ */
+typedef enum {
+    PNG_COMPRESSION_NONE = 0,    /**< Stored blocks only, no compression */
+    PNG_COMPRESSION_FAST = 1,    /**< Greedy matching with short hash chains */
+    PNG_COMPRESSION_DEFAULT = 6, /**< Lazy matching, good balance of speed and size */
+    PNG_COMPRESSION_MAX = 9      /**< Lazy matching with exhaustive hash chains */
+} libattopng_compression_t;
+
+
+/**
+ * @brief Progress callback.
+ *
+ * Called by \ref libattopng_get_data after each encoded line with the number
+ * of lines done so far and the image height.
+ */
+typedef void (*libattopng_progress_t)(void *data, size_t line, size_t height);
+
+
+/**
+ * @brief Output callback.
+ *
+ * Called by \ref libattopng_write with consecutive pieces of the PNG data
+ * stream. Returns 0 on success, any other value aborts the encoding.
+ */
+typedef int (*libattopng_sink_t)(void *data, const char *buf, size_t len);
+
+
 /**
  * @brief Reference to a PNG image
  *
@@ -41,6 +73,7 @@ typedef enum {
  */
 typedef struct {
     libattopng_type_t type;      /**< File type */
+    libattopng_compression_t compression; /**< Compression level of the image data */
     size_t capacity;             /**< Reserved memory for raw data */
     char *data;                  /**< Raw pixel data, format depends on type */
     uint32_t *palette;           /**< Palette for image */
@@ -48,14 +81,18 @@ typedef struct {
     size_t width;                /**< Image width */
     size_t height;               /**< Image height */
 
-    char *out;                   /**< Buffer to store final PNG */
+    char *out;                   /**< Buffer to store final PNG, or pending output while streaming */
     size_t out_pos;              /**< Current size of output buffer */
     size_t out_capacity;         /**< Capacity of output buffer */
     uint32_t crc;                /**< Currecnt CRC32 checksum */
-    uint16_t s1;                 /**< Helper variables for Adler checksum */
-    uint16_t s2;                 /**< Helper variables for Adler checksum */
+    uint32_t adler;              /**< Current Adler-32 checksum of the image data */
     size_t bpp;                  /**< Bytes per pixel */
 
+    libattopng_progress_t progress; /**< Progress callback, NULL if unused */
+    void *progress_data;         /**< User data passed to the progress callback */
+    libattopng_sink_t sink;      /**< Output callback while streaming, NULL otherwise */
+    void *sink_data;             /**< User data passed to the output callback */
+
     size_t stream_x;             /**< Current x coordinate for pixel streaming */
     size_t stream_y;             /**< Current y coordinate for pixel streaming */
 } libattopng_t;
@@ -108,6 +145,31 @@ void libattopng_destroy(libattopng_t *png);
 int libattopng_set_palette(libattopng_t *png, uint32_t *palette, size_t length);
 
 
+/**
+ * @function libattopng_set_compression
+ *
+ * @brief Sets the compression level used by \ref libattopng_get_data
+ *
+ * @param png   Reference to the image
+ * @param level One of the \ref libattopng_compression_t levels,
+ *              PNG_COMPRESSION_DEFAULT for new images
+ */
+void libattopng_set_compression(libattopng_t *png, libattopng_compression_t level);
+
+
+/**
+ * @function libattopng_set_progress
+ *
+ * @brief Sets a callback that reports the progress of \ref libattopng_get_data
+ *
+ * @param png      Reference to the image
+ * @param progress Callback, or NULL to disable progress reports
+ * @param data     User data passed to the callback
+ * @note The callback runs on the thread that encodes the image.
+ */
+void libattopng_set_progress(libattopng_t *png, libattopng_progress_t progress, void *data);
+
+
 /**
  * @function libattopng_set_pixel
  *
@@ -149,6 +211,24 @@ void libattopng_set_pixel(libattopng_t *png, size_t x, size_t y, uint32_t color)
 uint32_t libattopng_get_pixel(libattopng_t *png, size_t x, size_t y);
 
 
+/**
+ * @function libattopng_fill_rect
+ *
+ * @brief Sets all pixels within a rectangle to the same color
+ *
+ * @param png    Reference to the image
+ * @param x      X coordinate of the top left corner
+ * @param y      Y coordinate of the top left corner
+ * @param width  Width of the rectangle in pixels
+ * @param height Height of the rectangle in pixels
+ * @param color  The pixel value, see \ref libattopng_set_pixel
+ * @note The rectangle is clipped to the bounds of the image. Each row is
+ *       written as one span, which is much faster than setting the pixels
+ *       one by one.
+ */
+void libattopng_fill_rect(libattopng_t *png, size_t x, size_t y, size_t width, size_t height, uint32_t color);
+
+
 /**
  * @function libattopng_start_stream
  *
@@ -190,10 +270,40 @@ void libattopng_put_pixel(libattopng_t *png, uint32_t color);
  * @return A reference to the PNG output stream
  * @note The data stream is free'd when calling \ref libattopng_destroy and
  *       must not be free'd be the caller
+ * @see libattopng_write to encode large images without buffering the output
  */
 char *libattopng_get_data(libattopng_t *png, size_t *len);
 
 
+/**
+ * @function libattopng_write
+ *
+ * @brief Encodes the image and streams the PNG data to a callback
+ *
+ * @param png  Reference to the image
+ * @param sink Callback receiving the data stream in order
+ * @param data User data passed to the callback
+ * @return 0 on success, 1 on error (out of memory or the callback failed)
+ * @note The callback is invoked once per chunk, the image data is split into
+ *       IDAT chunks of at most 64KiB. The extra memory used for encoding
+ *       does not depend on the image size.
+ */
+int libattopng_write(libattopng_t *png, libattopng_sink_t sink, void *data);
+
+
+/**
+ * @function libattopng_write_file
+ *
+ * @brief Encodes the image and streams the PNG data to an open file
+ *
+ * @param png Reference to the image
+ * @param f   File opened for binary writing, it is not closed
+ * @return 0 on success, 1 on error
+ * @see libattopng_write
+ */
+int libattopng_write_file(libattopng_t *png, FILE *f);
+
+
 /**
  * @function libattopng_save
  *
@@ -206,6 +316,34 @@ char *libattopng_get_data(libattopng_t *png, size_t *len);
 int libattopng_save(libattopng_t *png, const char *filename);
 
 
+/**
+ * @function libattopng_crc32
+ *
+ * @brief Updates a CRC-32 (as used by PNG chunks and zlib) with more data
+ *
+ * @param crc  The CRC of the preceding data, 0 to start a new checksum
+ * @param data Data to add to the checksum
+ * @param len  Number of bytes in data
+ * @return The CRC of the preceding data followed by data
+ * @note Internal function, exposed for testing and benchmarking.
+ */
+uint32_t libattopng_crc32(uint32_t crc, const unsigned char *data, size_t len);
+
+
+/**
+ * @function libattopng_adler32
+ *
+ * @brief Updates an Adler-32 checksum (as used by the zlib stream) with more data
+ *
+ * @param adler The checksum of the preceding data, 1 to start a new checksum
+ * @param data  Data to add to the checksum
+ * @param len   Number of bytes in data
+ * @return The checksum of the preceding data followed by data
+ * @note Internal function, exposed for testing and benchmarking.
+ */
+uint32_t libattopng_adler32(uint32_t adler, const unsigned char *data, size_t len);
+
+
 #ifdef __cplusplus
 }
 #endif
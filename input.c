@@ -0,0 +1,467 @@
+#include "input.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_MAGIC   "PXARTREC"
+#define INPUT_VERSION 1
+
+typedef enum
+{
+    INPUT_SYNC,
+    INPUT_QUIT,
+    INPUT_MOTION,
+    INPUT_BUTTON_DOWN,
+    INPUT_BUTTON_UP,
+    INPUT_WHEEL,
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_RESIZE,
+} InputKind;
+
+void input_track(InputState *state, const SDL_Event *event)
+{
+    switch (event->type)
+    {
+        case SDL_MOUSEMOTION:
+            state->x       = event->motion.x;
+            state->y       = event->motion.y;
+            state->buttons = event->motion.state;
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+            state->x = event->button.x;
+            state->y = event->button.y;
+            state->buttons |= SDL_BUTTON(event->button.button);
+            break;
+        case SDL_MOUSEBUTTONUP:
+            state->x = event->button.x;
+            state->y = event->button.y;
+            state->buttons &= ~SDL_BUTTON(event->button.button);
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            // Carries the modifiers including the key itself
+            state->mod = event->key.keysym.mod;
+            break;
+    }
+}
+
+// Writes `value` 7 bits at a time, lowest first, with the top bit of each
+// byte set when more follow
+static void input_put(InputRecorder *recorder, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        putc((int)(value & 0x7F) | 0x80, recorder->file);
+        value >>= 7;
+    }
+    putc((int)value, recorder->file);
+}
+
+// Small values of either sign take one byte
+static void input_put_signed(InputRecorder *recorder, int32_t value)
+{
+    input_put(
+        recorder, ((uint32_t)value << 1) ^ (uint32_t)-(value < 0 ? 1 : 0)
+    );
+}
+
+static void input_put_kind(InputRecorder *recorder, InputKind kind)
+{
+    Uint32 time = SDL_GetTicks() - recorder->start;
+    putc(kind, recorder->file);
+    input_put(recorder, time - recorder->time);
+    recorder->time = time;
+    recorder->pending++;
+}
+
+static void input_put_position(InputRecorder *recorder, int x, int y)
+{
+    input_put_signed(recorder, x - recorder->x);
+    input_put_signed(recorder, y - recorder->y);
+    recorder->x = x;
+    recorder->y = y;
+}
+
+bool input_record_open(
+    InputRecorder *recorder, const char *file_name, const InputSession *session
+)
+{
+    *recorder = (InputRecorder){.file = fopen(file_name, "wb")};
+    if (recorder->file == NULL)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to create '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        return false;
+    }
+
+    fwrite(INPUT_MAGIC, 1, strlen(INPUT_MAGIC), recorder->file);
+    putc(INPUT_VERSION, recorder->file);
+    input_put(recorder, session->window_width);
+    input_put(recorder, session->window_height);
+    input_put(recorder, session->rows);
+    input_put(recorder, session->columns);
+    input_put(recorder, session->cell_size);
+
+    recorder->start = SDL_GetTicks();
+    return true;
+}
+
+void input_record(InputRecorder *recorder, const SDL_Event *event)
+{
+    switch (event->type)
+    {
+        case SDL_QUIT:
+            input_put_kind(recorder, INPUT_QUIT);
+            break;
+        case SDL_MOUSEMOTION:
+            input_put_kind(recorder, INPUT_MOTION);
+            input_put_position(recorder, event->motion.x, event->motion.y);
+            input_put(recorder, event->motion.state);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            input_put_kind(
+                recorder,
+                event->type == SDL_MOUSEBUTTONDOWN ? INPUT_BUTTON_DOWN
+                                                   : INPUT_BUTTON_UP
+            );
+            input_put(recorder, event->button.button);
+            input_put_position(recorder, event->button.x, event->button.y);
+            break;
+        case SDL_MOUSEWHEEL:
+            input_put_kind(recorder, INPUT_WHEEL);
+            input_put_signed(recorder, event->wheel.y);
+            input_put(recorder, event->wheel.direction);
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            input_put_kind(
+                recorder,
+                event->type == SDL_KEYDOWN ? INPUT_KEY_DOWN : INPUT_KEY_UP
+            );
+            input_put(recorder, (uint32_t)event->key.keysym.sym);
+            input_put(recorder, event->key.keysym.mod);
+            input_put(recorder, event->key.repeat);
+            break;
+        case SDL_WINDOWEVENT:
+            if (event->window.event != SDL_WINDOWEVENT_SIZE_CHANGED)
+                break;
+            input_put_kind(recorder, INPUT_RESIZE);
+            input_put(recorder, event->window.data1);
+            input_put(recorder, event->window.data2);
+            break;
+    }
+}
+
+void input_record_sync(InputRecorder *recorder)
+{
+    if (recorder->pending == 0)
+        return;
+
+    putc(INPUT_SYNC, recorder->file);
+    recorder->pending = 0;
+}
+
+bool input_record_close(InputRecorder *recorder)
+{
+    bool ok = !ferror(recorder->file);
+    ok      = fclose(recorder->file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "ERROR: Failed to write input log\n");
+
+    *recorder = (InputRecorder){.file = NULL};
+    return ok;
+}
+
+// Reads a value written by input_put(). Returns false past the end of the
+// log or on an overlong value.
+static bool input_get(InputReplay *replay, uint32_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (replay->offset == replay->size)
+            return false;
+
+        uint8_t byte = replay->data[replay->offset++];
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool input_get_signed(InputReplay *replay, int32_t *value)
+{
+    uint32_t bits;
+    if (!input_get(replay, &bits))
+        return false;
+
+    *value = (int32_t)(bits >> 1) ^ -(int32_t)(bits & 1);
+    return true;
+}
+
+static bool input_get_position(InputReplay *replay, int *x, int *y)
+{
+    int32_t dx, dy;
+    if (!input_get_signed(replay, &dx) || !input_get_signed(replay, &dy))
+        return false;
+
+    *x = replay->x + dx;
+    *y = replay->y + dy;
+    return true;
+}
+
+bool input_replay_open(
+    InputReplay *replay,
+    const char *file_name,
+    SDL_Window *window,
+    InputSession *session,
+    bool realtime
+)
+{
+    *replay = (InputReplay){.window = window, .realtime = realtime};
+
+    FILE *file = fopen(file_name, "rb");
+    long size  = -1;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to open '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        if (file != NULL)
+            fclose(file);
+        return false;
+    }
+
+    // The whole log is read up front, the replay does no file IO
+    replay->size = (size_t)size;
+    replay->data = malloc(replay->size > 0 ? replay->size : 1);
+    bool ok      = replay->data != NULL &&
+              fread(replay->data, 1, replay->size, file) == replay->size;
+    fclose(file);
+
+    size_t magic = strlen(INPUT_MAGIC);
+    uint32_t fields[5];
+    ok = ok && replay->size > magic &&
+         memcmp(replay->data, INPUT_MAGIC, magic) == 0 &&
+         replay->data[magic] == INPUT_VERSION;
+    replay->offset = magic + 1;
+    for (int i = 0; ok && i < 5; ++i)
+        ok = input_get(replay, &fields[i]) && fields[i] <= INT32_MAX;
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: '%s' is not an input log\n", file_name);
+        input_replay_close(replay);
+        return false;
+    }
+
+    *session = (InputSession){
+        .window_width  = (int)fields[0],
+        .window_height = (int)fields[1],
+        .rows          = (int)fields[2],
+        .columns       = (int)fields[3],
+        .cell_size     = (int)fields[4]
+    };
+    SDL_SetWindowSize(window, session->window_width, session->window_height);
+
+    replay->start = SDL_GetTicks();
+    return true;
+}
+
+// Decodes the record at the current offset into `event`
+static bool input_decode(InputReplay *replay, SDL_Event *event)
+{
+    uint32_t kind, delay, a, b, c;
+    int x, y;
+    if (!input_get(replay, &kind) || !input_get(replay, &delay))
+        return false;
+    replay->time += delay;
+
+    switch (kind)
+    {
+        case INPUT_QUIT:
+            *event = (SDL_Event){.type = SDL_QUIT};
+            return true;
+        case INPUT_MOTION:
+            if (!input_get_position(replay, &x, &y) || !input_get(replay, &a))
+                return false;
+            *event = (SDL_Event){
+                .motion = {
+                    .type  = SDL_MOUSEMOTION,
+                    .state = a,
+                    .x     = x,
+                    .y     = y,
+                    .xrel  = x - replay->x,
+                    .yrel  = y - replay->y,
+                }
+            };
+            break;
+        case INPUT_BUTTON_DOWN:
+        case INPUT_BUTTON_UP:
+            if (!input_get(replay, &a) || !input_get_position(replay, &x, &y))
+                return false;
+            *event = (SDL_Event){
+                .button = {
+                    .type   = kind == INPUT_BUTTON_DOWN ? SDL_MOUSEBUTTONDOWN
+                                                        : SDL_MOUSEBUTTONUP,
+                    .button = (Uint8)a,
+                    .state  = kind == INPUT_BUTTON_DOWN ? SDL_PRESSED
+                                                        : SDL_RELEASED,
+                    .clicks = 1,
+                    .x      = x,
+                    .y      = y,
+                }
+            };
+            break;
+        case INPUT_WHEEL:
+        {
+            int32_t steps;
+            if (!input_get_signed(replay, &steps) || !input_get(replay, &a))
+                return false;
+            *event = (SDL_Event){
+                .wheel = {
+                    .type      = SDL_MOUSEWHEEL,
+                    .y         = steps,
+                    .direction = a,
+                }
+            };
+            return true;
+        }
+        case INPUT_KEY_DOWN:
+        case INPUT_KEY_UP:
+            if (!input_get(replay, &a) || !input_get(replay, &b) ||
+                !input_get(replay, &c))
+            {
+                return false;
+            }
+            *event = (SDL_Event){
+                .key = {
+                    .type   = kind == INPUT_KEY_DOWN ? SDL_KEYDOWN : SDL_KEYUP,
+                    .state  = kind == INPUT_KEY_DOWN ? SDL_PRESSED
+                                                     : SDL_RELEASED,
+                    .repeat = (Uint8)c,
+                    .keysym = {.sym = (SDL_Keycode)a, .mod = (Uint16)b},
+                }
+            };
+            return true;
+        case INPUT_RESIZE:
+            if (!input_get(replay, &a) || !input_get(replay, &b))
+                return false;
+            SDL_SetWindowSize(replay->window, (int)a, (int)b);
+            *event = (SDL_Event){
+                .window = {
+                    .type  = SDL_WINDOWEVENT,
+                    .event = SDL_WINDOWEVENT_SIZE_CHANGED,
+                    .data1 = (Sint32)a,
+                    .data2 = (Sint32)b,
+                }
+            };
+            return true;
+        default:
+            return false;
+    }
+
+    replay->x = x;
+    replay->y = y;
+    return true;
+}
+
+// Hands out the next record, or an SDL_QUIT event once there is none
+static bool input_replay_next(InputReplay *replay, SDL_Event *event)
+{
+    size_t offset = replay->offset;
+    if (input_decode(replay, event))
+    {
+        replay->events++;
+        return true;
+    }
+
+    if (offset < replay->size)
+        fprintf(stderr, "ERROR: Input log is damaged, replay stops here\n");
+    replay->offset = replay->size;
+    *event         = (SDL_Event){.type = SDL_QUIT};
+    return true;
+}
+
+// Time the next record was written at, in milliseconds from the start
+static Uint32 input_replay_due(InputReplay *replay)
+{
+    size_t offset = replay->offset;
+    uint32_t kind, delay;
+    bool ok        = input_get(replay, &kind) && input_get(replay, &delay);
+    replay->offset = offset;
+
+    return ok ? replay->time + delay : replay->time;
+}
+
+// Live events that still reach the editor during a replay
+static bool input_replay_live(const SDL_Event *event)
+{
+    return event->type == SDL_QUIT ||
+           event->type == SDL_RENDER_TARGETS_RESET ||
+           event->type == SDL_RENDER_DEVICE_RESET;
+}
+
+bool input_replay_wait(InputReplay *replay, SDL_Event *event, int timeout)
+{
+    // The next group starts after the sync that ended the last one
+    if (replay->offset < replay->size &&
+        replay->data[replay->offset] == INPUT_SYNC)
+    {
+        replay->offset++;
+    }
+
+    Uint32 due = input_replay_due(replay);
+    Uint32 now = SDL_GetTicks() - replay->start;
+    if (replay->realtime && due > now)
+    {
+        Uint32 delay = due - now;
+        if (timeout >= 0 && (Uint32)timeout < delay)
+            delay = (Uint32)timeout;
+
+        if (SDL_WaitEventTimeout(event, (int)delay) &&
+            input_replay_live(event))
+        {
+            return true;
+        }
+        if (SDL_GetTicks() - replay->start < due)
+            return false;
+    }
+
+    while (SDL_PollEvent(event))
+    {
+        if (input_replay_live(event))
+            return true;
+    }
+
+    return input_replay_next(replay, event);
+}
+
+bool input_replay_poll(InputReplay *replay, SDL_Event *event)
+{
+    if (replay->offset == replay->size ||
+        replay->data[replay->offset] == INPUT_SYNC)
+    {
+        return false;
+    }
+
+    return input_replay_next(replay, event);
+}
+
+void input_replay_close(InputReplay *replay)
+{
+    free(replay->data);
+    *replay = (InputReplay){.data = NULL};
+}
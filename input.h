@@ -0,0 +1,105 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Mouse and modifier state as of the last handled event. The editor reads it
+// instead of asking SDL, so a replayed session sees the state it was recorded
+// with rather than the one of the real mouse.
+typedef struct
+{
+    int x;
+    int y;
+    Uint32 buttons;
+    Uint16 mod;
+} InputState;
+
+void input_track(InputState *state, const SDL_Event *event);
+
+// What a replay must start from to give the same result: the recorded
+// session ran on a `rows` by `columns` canvas with `cell_size` pixels per
+// cell, in a window of `window_width` by `window_height`
+typedef struct
+{
+    int window_width;
+    int window_height;
+    int rows;
+    int columns;
+    int cell_size;
+} InputSession;
+
+// A session log is a header with the InputSession, then one record per
+// event: a kind byte, the milliseconds since the previous record and the
+// fields the editor uses, as variable length integers with mouse positions
+// relative to the previous one. A sync record ends the events handled before
+// each frame that was rendered, so a replay renders the same frames.
+typedef struct
+{
+    FILE *file;
+    Uint32 start;
+    Uint32 time;
+    int x;
+    int y;
+    // Records written since the last sync
+    int pending;
+} InputRecorder;
+
+// Creates the log `file_name` for a session starting now. Returns false, with
+// an error printed, if it cannot be written.
+bool input_record_open(
+    InputRecorder *recorder, const char *file_name, const InputSession *session
+);
+
+// Appends `event` to the log, if it is one the editor acts on
+void input_record(InputRecorder *recorder, const SDL_Event *event);
+
+// Ends the group of events handled before a frame is rendered
+void input_record_sync(InputRecorder *recorder);
+
+// Returns false if the log could not be written completely
+bool input_record_close(InputRecorder *recorder);
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    SDL_Window *window;
+    // Keep the recorded pace instead of replaying as fast as possible
+    bool realtime;
+    Uint32 start;
+    Uint32 time;
+    int x;
+    int y;
+    // Events handed out so far
+    int events;
+} InputReplay;
+
+// Reads the log `file_name` into memory, fills in `session` and resizes
+// `window` to the recorded size. Returns false, with an error printed, if it
+// cannot be read or is not a session log.
+bool input_replay_open(
+    InputReplay *replay,
+    const char *file_name,
+    SDL_Window *window,
+    InputSession *session,
+    bool realtime
+);
+
+// Next recorded event, for SDL_WaitEventTimeout(). A real time replay waits
+// for the time it was recorded at, at most `timeout` milliseconds unless it
+// is -1. Live quit and render reset events are passed on, any other live
+// input is dropped. An SDL_QUIT event is made up once the log ends.
+bool input_replay_wait(InputReplay *replay, SDL_Event *event, int timeout);
+
+// Next event of the current group, for SDL_PollEvent(). Returns false at the
+// end of the group, and of the log.
+bool input_replay_poll(InputReplay *replay, SDL_Event *event);
+
+void input_replay_close(InputReplay *replay);
+
+#endif // INPUT_H
@@ -1,54 +1,89 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-
+#include <unistd.h>
+
+#include "batch.h"
+#include "canvas.h"
+#include "export.h"
+#include "fill.h"
+#include "history.h"
+#include "import.h"
 #include "include/libattopng.h"
+#include "input.h"
+#include "project.h"
+#include "selection.h"
+#include "view.h"
 
 // TODO: Increase and dicrease brush size
-// TODO: row 0 is (0,0) even when GRID_MIN_HEIGHT is 80
-// TODO: select area click #1 cell and #2 cell and all cells inbetween are
-//       selected
-
-#define RGBA(r, g, b, a) ((r) | ((g) << 8) | ((b) << 16) | ((a) << 24))
-
-#define WIDTH            800
-#define HEIGHT           800
-#define BACKGROUND_COLOR 28, 28, 28, 255
 
 #define GRID_MIN_WIDTH  0
 #define GRID_MIN_HEIGHT 80
-#define GRID_MAX_WIDTH  WIDTH
-#define GRID_MAX_HEIGHT HEIGHT
 #define GRID_COLOR      32, 32, 32, 255
 
-#define CELL_SIZE 20
+#define SELECTION_COLOR 255, 255, 255, 255
+
+// Size of the color blocks in the top bar and the space around them
+#define BLOCK_SIZE          20
+#define COLOR_BLOCK_PADDING 10
+
+// Zoom of the view, as a multiple of the cell size in 1/VIEW_SCALE_ONE steps
+#define MIN_ZOOM (VIEW_SCALE_ONE / 16)
+#define MAX_ZOOM (VIEW_SCALE_ONE * 32)
+
+// Grid lines are hidden once cells are drawn smaller than this many pixels
+#define GRID_HIDE_SIZE 4
 
-#define MAX_CELLS   (GRID_MAX_WIDTH / CELL_SIZE) * (GRID_MAX_HEIGHT / CELL_SIZE)
-#define MAX_ROWS    GRID_MAX_HEIGHT / CELL_SIZE - 1
-#define MAX_COLUMNS GRID_MAX_WIDTH / CELL_SIZE - 1
+#define DEFAULT_ROWS    36
+#define DEFAULT_COLUMNS 40
 
-#define ADD_COLOR(r, g, b)                                                     \
-    brush_colors.colors[brush_colors.size] = (SDL_Color){r, g, b, 255};        \
-    brush_colors.size++;
+// Bounds of the window size picked at startup, it can be resized later
+#define MIN_WINDOW_WIDTH  640
+#define MIN_WINDOW_HEIGHT 480
+#define MAX_WINDOW_WIDTH  1280
+#define MAX_WINDOW_HEIGHT 960
 
+#define STROKE_BATCH 64
+
+// Memory kept for undo, in megabytes
+#define DEFAULT_HISTORY_SIZE 64
+#define MAX_HISTORY_SIZE     4096
+
+// Project file Ctrl+S saves to when none was given on the command line
+#define DEFAULT_PROJECT "untitled" PROJECT_EXTENSION
+
+// Milliseconds between redraws while a save is running, to show its progress
+#define SAVE_STATUS_INTERVAL 100
+
+// The grid looks the same around every cell, so a block of grid cells big
+// enough to cover the canvas area is rendered once into a texture. Each frame
+// copies the part that covers the visible cells.
 typedef struct
 {
-    int x;
-    int y;
-} Cell;
-
+    SDL_Texture *texture;
+    int columns;
+    int rows;
+    int cell_size;
+} GridTexture;
+
+// One texture per canvas tile at one texel per cell, scaled up to the cell
+// size when drawn. Empty tiles have no texture, and a tile is only uploaded
+// again once it changed and is on screen.
 typedef struct
 {
-    Cell grid[GRID_MAX_WIDTH / CELL_SIZE][GRID_MAX_HEIGHT / CELL_SIZE];
-    struct
-    {
-        int w;
-        int h;
-    } size;
-} Cells;
+    SDL_Texture **tiles;
+    // Set for tiles whose texture is older than their cells
+    Uint8 *stale;
+    int tile_rows;
+    int tile_columns;
+    // Texel of every canvas value, as of the last upload
+    Uint32 colors[256];
+} CanvasTexture;
 
 typedef struct
 {
@@ -61,277 +96,1617 @@ typedef struct
     GridPos grid_pos;
 } CursorBrush;
 
+// Cells the mouse moved through while the left button is held. The samples
+// are collected from the frame's events and painted in one batch, joined by
+// lines so fast drags leave no gaps.
 typedef struct
 {
-    SDL_Color colors[99];
-    int size;
-    int selected;
-} BrushColors;
+    bool active;
+    // Cell the next segment starts from
+    GridPos last;
+    GridPos samples[STROKE_BATCH];
+    int count;
+} Stroke;
+
+// What a left click on the canvas does
+typedef enum
+{
+    TOOL_BRUSH,
+    TOOL_FILL,
+    TOOL_SELECT,
+} Tool;
 
+// Rectangle of cells picked with the select tool
 typedef struct
 {
-    int x;
-    int y;
-    SDL_Color color;
-} Point;
+    bool active;
+    CellRange range;
+    // Left button drag in progress, either marking a new rectangle or moving
+    // the selected one
+    bool marking;
+    bool moving;
+    // Cells the drag started at and is at now
+    GridPos anchor;
+    GridPos cursor;
+} Selection;
 
-bool point_exists(Point **points, int *points_size, Point *point)
+void save_point(
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    int row,
+    int column
+)
+{
+    history_set(history, canvas, row, column, brush_colors->selected + 1);
+}
+
+// Paints the cells on the line between two cells (Bresenham), skipping any
+// that are outside the canvas
+void save_line(
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    GridPos from,
+    GridPos to
+)
 {
-    for (int i = 0; i < *points_size; ++i)
+    int d_col = abs(to.column - from.column);
+    int d_row = -abs(to.row - from.row);
+    int s_col = from.column < to.column ? 1 : -1;
+    int s_row = from.row < to.row ? 1 : -1;
+    int error = d_col + d_row;
+
+    GridPos pos = from;
+    for (;;)
     {
-        if (points[i]->x == point->x && points[i]->y == point->y)
+        if (canvas_contains(canvas, pos.row, pos.column))
+            save_point(canvas, history, brush_colors, pos.row, pos.column);
+
+        if (pos.row == to.row && pos.column == to.column)
+            break;
+
+        int error2 = 2 * error;
+        if (error2 >= d_row)
         {
-            return true;
+            error += d_row;
+            pos.column += s_col;
+        }
+        if (error2 <= d_col)
+        {
+            error += d_col;
+            pos.row += s_row;
         }
     }
+}
 
-    return false;
+void stroke_flush(
+    Stroke *stroke, Canvas *canvas, History *history, BrushColors *brush_colors
+)
+{
+    for (int i = 0; i < stroke->count; ++i)
+    {
+        save_line(
+            canvas, history, brush_colors, stroke->last, stroke->samples[i]
+        );
+        stroke->last = stroke->samples[i];
+    }
+    stroke->count = 0;
 }
 
-// FIXME: Image is bigger or smaller than the canves sometimes
-void save_point(
-    Point **points, int *points_size, BrushColors *brush_colors, int x, int y
+void stroke_add(
+    Stroke *stroke,
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    GridPos cell
+)
+{
+    if (stroke->count == STROKE_BATCH)
+        stroke_flush(stroke, canvas, history, brush_colors);
+
+    stroke->samples[stroke->count++] = cell;
+}
+
+// Starts a stroke if the left button was pressed on the canvas. Everything
+// it paints is undone as one step.
+void stroke_press(
+    Stroke *stroke,
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    View *view,
+    SDL_MouseButtonEvent *button
 )
 {
-    Point *point = malloc(sizeof(Point));
-    point->x     = x;
-    point->y     = y;
-    point->color = brush_colors->colors[brush_colors->selected];
+    if (button->button != SDL_BUTTON_LEFT)
+        return;
+
+    GridPos cell;
+    view_screen_to_cell(view, button->x, button->y, &cell.row, &cell.column);
+    if (!canvas_contains(canvas, cell.row, cell.column))
+        return;
+
+    // Samples of a previous stroke end where that stroke ended
+    stroke_flush(stroke, canvas, history, brush_colors);
+    history_begin(history);
+    stroke->active = true;
+    stroke->last   = cell;
+    stroke_add(stroke, canvas, history, brush_colors, cell);
+}
 
-    for (int i = 0; i < *points_size; ++i)
+void stroke_motion(
+    Stroke *stroke,
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    View *view,
+    SDL_MouseMotionEvent *motion
+)
+{
+    if (!stroke->active)
+        return;
+
+    // The release may have happened outside the window
+    if ((motion->state & SDL_BUTTON_LMASK) == 0)
     {
-        if (points[i]->x == point->x && points[i]->y == point->y)
-        {
-            points[i]->color = point->color;
-            return;
-        }
+        stroke_flush(stroke, canvas, history, brush_colors);
+        history_end(history);
+        stroke->active = false;
+        return;
+    }
+
+    GridPos cell;
+    view_screen_to_cell(view, motion->x, motion->y, &cell.row, &cell.column);
+
+    GridPos last =
+        stroke->count > 0 ? stroke->samples[stroke->count - 1] : stroke->last;
+    if (cell.row != last.row || cell.column != last.column)
+        stroke_add(stroke, canvas, history, brush_colors, cell);
+}
+
+// Bucket fills from the cell the left button was pressed on, as one undo step
+void fill_press(
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    View *view,
+    FillMode mode,
+    SDL_MouseButtonEvent *button
+)
+{
+    if (button->button != SDL_BUTTON_LEFT)
+        return;
+
+    GridPos cell;
+    view_screen_to_cell(view, button->x, button->y, &cell.row, &cell.column);
+    if (!canvas_contains(canvas, cell.row, cell.column))
+        return;
+
+    history_begin(history);
+    fill(
+        canvas,
+        history,
+        cell.row,
+        cell.column,
+        brush_colors->selected + 1,
+        mode
+    );
+    history_end(history);
+}
+
+// Starts marking a new selection, or moving the current one if the left
+// button was pressed inside it
+void selection_press(
+    Selection *selection,
+    Canvas *canvas,
+    View *view,
+    SDL_MouseButtonEvent *button
+)
+{
+    if (button->button != SDL_BUTTON_LEFT)
+        return;
+
+    GridPos cell;
+    view_screen_to_cell(view, button->x, button->y, &cell.row, &cell.column);
+    if (!canvas_contains(canvas, cell.row, cell.column))
+    {
+        selection->active = false;
+        return;
     }
 
-    points[*points_size] = point;
-    *points_size += 1;
+    CellRange *range  = &selection->range;
+    selection->anchor = cell;
+    selection->cursor = cell;
+    if (selection->active && cell.row >= range->row &&
+        cell.row < range->row + range->rows && cell.column >= range->column &&
+        cell.column < range->column + range->columns)
+    {
+        selection->moving = true;
+        return;
+    }
+
+    selection->active  = true;
+    selection->marking = true;
+    *range = selection_between(cell.row, cell.column, cell.row, cell.column);
 }
 
-void build_grid(Cells *cells)
+void selection_motion(
+    Selection *selection,
+    Canvas *canvas,
+    View *view,
+    SDL_MouseMotionEvent *motion
+)
 {
-    for (int col = GRID_MIN_WIDTH; col < GRID_MAX_WIDTH; col += CELL_SIZE)
+    if (!selection->marking && !selection->moving)
+        return;
+
+    GridPos cell;
+    view_screen_to_cell(view, motion->x, motion->y, &cell.row, &cell.column);
+    selection->cursor = cell;
+    if (!selection->marking)
+        return;
+
+    // The corner under the mouse stays on the canvas
+    cell.row    = SDL_max(0, SDL_min(cell.row, canvas->rows - 1));
+    cell.column = SDL_max(0, SDL_min(cell.column, canvas->columns - 1));
+    selection->range = selection_between(
+        selection->anchor.row, selection->anchor.column, cell.row, cell.column
+    );
+}
+
+// Ends a drag. A dragged selection moves its cells as one undo step.
+void selection_release(
+    Selection *selection,
+    Canvas *canvas,
+    History *history,
+    SDL_MouseButtonEvent *button
+)
+{
+    if (button->button != SDL_BUTTON_LEFT)
+        return;
+
+    int rows    = selection->cursor.row - selection->anchor.row;
+    int columns = selection->cursor.column - selection->anchor.column;
+    if (selection->moving && (rows != 0 || columns != 0))
+    {
+        history_begin(history);
+        selection_move(canvas, history, selection->range, rows, columns);
+        history_end(history);
+
+        selection->range.row += rows;
+        selection->range.column += columns;
+        selection->active = selection_clip(canvas, &selection->range);
+    }
+
+    selection->marking = false;
+    selection->moving  = false;
+}
+
+// Handles the keys that act on the selection: Ctrl+A selects everything,
+// Ctrl+C, Ctrl+X and Ctrl+V copy, cut and paste at `cursor`, Ctrl+F fills
+// with the brush color, Delete empties and Escape deselects. Returns true if
+// `key` was one of them.
+bool selection_key(
+    Selection *selection,
+    Clipboard *clipboard,
+    Canvas *canvas,
+    History *history,
+    BrushColors *brush_colors,
+    GridPos cursor,
+    SDL_Keysym *key
+)
+{
+    bool ctrl        = (key->mod & KMOD_CTRL) != 0;
+    CellRange *range = &selection->range;
+
+    if (ctrl && key->sym == 'a')
+    {
+        *range = (CellRange){
+            .row     = 0,
+            .column  = 0,
+            .rows    = canvas->rows,
+            .columns = canvas->columns
+        };
+        selection->active = true;
+        return true;
+    }
+
+    if (ctrl && key->sym == 'v')
+    {
+        if (clipboard->cells == NULL)
+            return true;
+
+        history_begin(history);
+        selection_paste(
+            canvas, history, clipboard, cursor.row, cursor.column
+        );
+        history_end(history);
+
+        // The pasted block is selected, ready to be moved
+        *range = (CellRange){
+            .row     = cursor.row,
+            .column  = cursor.column,
+            .rows    = clipboard->rows,
+            .columns = clipboard->columns
+        };
+        selection->active = selection_clip(canvas, range);
+        return true;
+    }
+
+    if (!selection->active)
+        return false;
+
+    if (key->sym == SDLK_ESCAPE)
     {
-        for (int row = GRID_MIN_HEIGHT; row < GRID_MAX_HEIGHT; row += CELL_SIZE)
+        selection->active = false;
+        return true;
+    }
+
+    if (ctrl && (key->sym == 'c' || key->sym == 'x'))
+    {
+        if (!selection_copy(canvas, *range, clipboard))
         {
-            Cell cell = {.x = col, .y = row};
-            cells->grid[row / CELL_SIZE][col / CELL_SIZE] = cell;
+            fprintf(stderr, "ERROR: Failed to copy selection\n");
         }
-        cells->size.w++;
-        cells->size.h++;
+        else if (key->sym == 'x')
+        {
+            history_begin(history);
+            selection_fill(canvas, history, *range, CANVAS_EMPTY);
+            history_end(history);
+        }
+        return true;
     }
+
+    if (key->sym == SDLK_DELETE || key->sym == SDLK_BACKSPACE ||
+        (ctrl && key->sym == 'f'))
+    {
+        uint8_t value = key->sym == 'f' ? brush_colors->selected + 1
+                                        : CANVAS_EMPTY;
+        history_begin(history);
+        selection_fill(canvas, history, *range, value);
+        history_end(history);
+        return true;
+    }
+
+    return false;
 }
 
-void draw_grid(SDL_Renderer *ren, Cells *cells)
+// Outlines the selection, where it will land if it is being moved
+void draw_selection(SDL_Renderer *ren, View *view, Selection *selection)
 {
-    for (int col = 0; col < cells->size.w; ++col)
+    if (!selection->active)
+        return;
+
+    CellRange range = selection->range;
+    if (selection->moving)
     {
-        for (int row = 0; row < cells->size.h; ++row)
-        {
-            Cell cell = cells->grid[row][col];
+        range.row += selection->cursor.row - selection->anchor.row;
+        range.column += selection->cursor.column - selection->anchor.column;
+    }
 
-            SDL_Rect rect = {
-                .x = cell.x, .y = cell.y, .w = CELL_SIZE, .h = CELL_SIZE
-            };
+    SDL_Rect rect = view_cells_rect(
+        view, range.row, range.column, range.rows, range.columns
+    );
+    SDL_SetRenderDrawColor(ren, SELECTION_COLOR);
+    SDL_RenderDrawRect(ren, &rect);
+}
 
-            SDL_SetRenderDrawColor(ren, GRID_COLOR);
-            SDL_RenderDrawRect(ren, &rect);
-        }
+// Outlines every cell in `range`, with one line along each side of a row or
+// column of cells rather than a rectangle per cell
+void render_grid(SDL_Renderer *ren, View *view, CellRange *range)
+{
+    SDL_Rect cells = view_cells_rect(
+        view, range->row, range->column, range->rows, range->columns
+    );
+    int right  = cells.x + cells.w - 1;
+    int bottom = cells.y + cells.h - 1;
+
+    SDL_SetRenderDrawColor(ren, GRID_COLOR);
+    for (int col = range->column; col < range->column + range->columns; ++col)
+    {
+        SDL_Rect rect = view_cell_rect(view, 0, col);
+        SDL_RenderDrawLine(ren, rect.x, cells.y, rect.x, bottom);
+        SDL_RenderDrawLine(
+            ren, rect.x + rect.w - 1, cells.y, rect.x + rect.w - 1, bottom
+        );
     }
+    for (int row = range->row; row < range->row + range->rows; ++row)
+    {
+        SDL_Rect rect = view_cell_rect(view, row, 0);
+        SDL_RenderDrawLine(ren, cells.x, rect.y, right, rect.y);
+        SDL_RenderDrawLine(
+            ren, cells.x, rect.y + rect.h - 1, right, rect.y + rect.h - 1
+        );
+    }
+}
+
+void grid_texture_free(GridTexture *grid)
+{
+    if (grid->texture != NULL)
+        SDL_DestroyTexture(grid->texture);
+    grid->texture = NULL;
 }
 
-void draw_color_blocks(
+// (Re)renders the grid texture if it was built for another cell size or
+// holds fewer than `rows` by `columns` cells. Returns false if the renderer
+// cannot render to textures.
+bool grid_texture_update(
+    SDL_Renderer *ren, GridTexture *grid, int cell_size, int rows, int columns
+)
+{
+    if (grid->texture != NULL && grid->cell_size == cell_size &&
+        grid->rows >= rows && grid->columns >= columns)
+    {
+        return true;
+    }
+
+    grid_texture_free(grid);
+    grid->texture = SDL_CreateTexture(
+        ren,
+        SDL_PIXELFORMAT_RGBA32,
+        SDL_TEXTUREACCESS_TARGET,
+        columns * cell_size,
+        rows * cell_size
+    );
+    if (grid->texture == NULL)
+        return false;
+
+    SDL_SetTextureBlendMode(grid->texture, SDL_BLENDMODE_BLEND);
+    if (SDL_SetRenderTarget(ren, grid->texture) != 0)
+    {
+        grid_texture_free(grid);
+        return false;
+    }
+    SDL_SetRenderDrawColor(ren, 0, 0, 0, 0);
+    SDL_RenderClear(ren);
+    View origin     = view_at(0, 0, cell_size);
+    CellRange cells = {.row = 0, .column = 0, .rows = rows, .columns = columns};
+    render_grid(ren, &origin, &cells);
+    SDL_SetRenderTarget(ren, NULL);
+
+    grid->columns   = columns;
+    grid->rows      = rows;
+    grid->cell_size = cell_size;
+    return true;
+}
+
+// Draws the grid lines of the cells inside `area`, unless the cells are too
+// small for them to be useful
+void draw_grid(
     SDL_Renderer *ren,
-    BrushColors *brush_colors,
-    Uint32 buttons,
-    SDL_Point cursor
+    GridTexture *grid,
+    View *view,
+    Canvas *canvas,
+    SDL_Rect *area
 )
 {
-    int padding = 10;
-    int x       = padding;
-    int y       = padding;
+    if (view->scale < GRID_HIDE_SIZE * VIEW_SCALE_ONE)
+        return;
+
+    CellRange range;
+    if (!view_visible_cells(view, *area, canvas->rows, canvas->columns, &range))
+        return;
+
+    // The texture holds whole pixel cells only. It is sized for the area
+    // rather than the visible cells, so that panning and resizing the canvas
+    // do not rebuild it.
+    int cell_size = view_pixel_size(view);
+    if (cell_size == 0)
+    {
+        render_grid(ren, view, &range);
+        return;
+    }
+    int rows    = area->h / cell_size + 2;
+    int columns = area->w / cell_size + 2;
+    if (!grid_texture_update(ren, grid, cell_size, rows, columns))
+    {
+        render_grid(ren, view, &range);
+        return;
+    }
+
+    SDL_Rect dst = view_cells_rect(
+        view, range.row, range.column, range.rows, range.columns
+    );
+    SDL_Rect src = {.x = 0, .y = 0, .w = dst.w, .h = dst.h};
+    SDL_RenderCopy(ren, grid->texture, &src, &dst);
+}
+
+// Where the swatch of brush color `index` is drawn in the top bar
+SDL_Rect color_block_rect(int index)
+{
+    return (SDL_Rect){
+        .x = COLOR_BLOCK_PADDING + index * (COLOR_BLOCK_PADDING + BLOCK_SIZE),
+        .y = COLOR_BLOCK_PADDING,
+        .w = BLOCK_SIZE,
+        .h = BLOCK_SIZE
+    };
+}
+
+// Index of the swatch under `point`, or -1 if there is none
+int color_block_at(const BrushColors *brush_colors, SDL_Point point)
+{
+    for (int i = 0; i < brush_colors->size; ++i)
+    {
+        SDL_Rect rect = color_block_rect(i);
+        if (SDL_PointInRect(&point, &rect))
+            return i;
+    }
+
+    return -1;
+}
+
+void draw_color_blocks(SDL_Renderer *ren, const BrushColors *brush_colors)
+{
+    int padding = COLOR_BLOCK_PADDING;
 
     for (int i = 0; i < brush_colors->size; ++i)
     {
         SDL_Color color = brush_colors->colors[i];
 
-        SDL_Rect rect = {.x = x, .y = y, .w = CELL_SIZE, .h = CELL_SIZE};
+        SDL_Rect rect = color_block_rect(i);
 
         if (brush_colors->selected == i)
         {
             SDL_Rect selected_rect = {
                 .x = rect.x - padding / 2,
                 .y = rect.y - padding / 2,
-                .w = CELL_SIZE + padding,
-                .h = CELL_SIZE + padding
+                .w = BLOCK_SIZE + padding,
+                .h = BLOCK_SIZE + padding
             };
 
             SDL_SetRenderDrawColor(ren, 255, 0, 0, 0);
             SDL_RenderDrawRect(ren, &selected_rect);
         }
 
-        SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, color.a);
-        SDL_RenderFillRect(ren, &rect);
-
-        if (SDL_PointInRect(&cursor, &rect) &&
-            (buttons & SDL_BUTTON_LMASK) != 0)
+        SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRect(ren, &rect);
+    }
+}
+
+// Texture of a rendered string, rasterised again only when the string or
+// its color changes
+typedef struct
+{
+    char text[192];
+    SDL_Color color;
+    SDL_Texture *texture;
+    int w;
+    int h;
+} CachedText;
+
+typedef struct
+{
+    CachedText grid_size;
+    CachedText points;
+    CachedText cursor;
+    CachedText zoom;
+    CachedText tool;
+    CachedText save_status;
+} InfoBar;
+
+void cached_text_free(CachedText *cached)
+{
+    if (cached->texture != NULL)
+        SDL_DestroyTexture(cached->texture);
+    cached->texture = NULL;
+    cached->text[0] = '\0';
+}
+
+// Returns the texture for `text`, NULL if there is nothing to draw
+SDL_Texture *cached_text_get(
+    SDL_Renderer *ren,
+    TTF_Font *font,
+    CachedText *cached,
+    const char *text,
+    SDL_Color color
+)
+{
+    if (cached->texture != NULL && strcmp(cached->text, text) == 0 &&
+        memcmp(&cached->color, &color, sizeof(color)) == 0)
+    {
+        return cached->texture;
+    }
+
+    cached_text_free(cached);
+    if (text[0] == '\0')
+        return NULL;
+
+    SDL_Surface *surface = TTF_RenderText_Blended(font, text, color);
+    if (surface == NULL)
+        return NULL;
+
+    cached->texture = SDL_CreateTextureFromSurface(ren, surface);
+    cached->w       = surface->w;
+    cached->h       = surface->h;
+    SDL_FreeSurface(surface);
+
+    if (cached->texture != NULL)
+    {
+        snprintf(cached->text, sizeof(cached->text), "%s", text);
+        cached->color = color;
+    }
+    return cached->texture;
+}
+
+// Draws `text` at `x`, `y` and moves `x` past it
+void draw_text(
+    SDL_Renderer *ren,
+    TTF_Font *font,
+    CachedText *cached,
+    const char *text,
+    int *x,
+    int y
+)
+{
+    int padding = 10;
+
+    SDL_Texture *texture = cached_text_get(
+        ren, font, cached, text, (SDL_Color){255, 255, 255, 255}
+    );
+    if (texture == NULL)
+        return;
+
+    SDL_Rect rect = {.x = *x, .y = y, .w = cached->w, .h = cached->h};
+
+    SDL_RenderCopy(ren, texture, NULL, &rect);
+
+    SDL_SetRenderDrawColor(ren, BACKGROUND_COLOR);
+    SDL_RenderDrawRect(ren, &rect);
+
+    *x += cached->w + padding;
+}
+
+void info_bar_free(InfoBar *info)
+{
+    cached_text_free(&info->grid_size);
+    cached_text_free(&info->points);
+    cached_text_free(&info->cursor);
+    cached_text_free(&info->zoom);
+    cached_text_free(&info->tool);
+    cached_text_free(&info->save_status);
+}
+
+void draw_info(
+    SDL_Renderer *ren,
+    TTF_Font *font,
+    InfoBar *info,
+    Canvas *canvas,
+    int zoom,
+    const char *tool,
+    int mouse_x,
+    int mouse_y,
+    const char *save_status
+)
+{
+    int padding = 10;
+    int x       = 5;
+    int y       = BLOCK_SIZE + padding * 2;
+
+    char text[50];
+
+    snprintf(
+        text,
+        sizeof(text),
+        "rows/columns: %i/%i",
+        canvas->rows,
+        canvas->columns
+    );
+    draw_text(ren, font, &info->grid_size, text, &x, y);
+
+    snprintf(text, sizeof(text), "Total points: %i", canvas->painted);
+    draw_text(ren, font, &info->points, text, &x, y);
+
+    snprintf(text, sizeof(text), "%ix%i", mouse_x, mouse_y);
+    draw_text(ren, font, &info->cursor, text, &x, y);
+
+    snprintf(
+        text, sizeof(text), "Zoom: %i%%", zoom * 100 / VIEW_SCALE_ONE
+    );
+    draw_text(ren, font, &info->zoom, text, &x, y);
+
+    draw_text(ren, font, &info->tool, tool, &x, y);
+
+    draw_text(ren, font, &info->save_status, save_status, &x, y);
+}
+
+// Range of tiles covering the cells in `range`
+CellRange tiles_of_cells(CellRange *range)
+{
+    int top    = range->row >> CANVAS_TILE_BITS;
+    int left   = range->column >> CANVAS_TILE_BITS;
+    int bottom = (range->row + range->rows - 1) >> CANVAS_TILE_BITS;
+    int right  = (range->column + range->columns - 1) >> CANVAS_TILE_BITS;
+
+    return (CellRange){
+        .row     = top,
+        .column  = left,
+        .rows    = bottom - top + 1,
+        .columns = right - left + 1
+    };
+}
+
+void render_canvas(
+    SDL_Renderer *ren,
+    View *view,
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    CellRange *range
+)
+{
+    CellRange tiles = tiles_of_cells(range);
+
+    for (int tile_row = tiles.row; tile_row < tiles.row + tiles.rows;
+         ++tile_row)
+    {
+        for (int tile_col = tiles.column;
+             tile_col < tiles.column + tiles.columns;
+             ++tile_col)
+        {
+            const CanvasTile *tile = canvas_tile(canvas, tile_row, tile_col);
+            if (tile == NULL)
+                continue;
+
+            int top    = SDL_max(range->row, tile_row << CANVAS_TILE_BITS);
+            int left   = SDL_max(range->column, tile_col << CANVAS_TILE_BITS);
+            int bottom = SDL_min(
+                range->row + range->rows, (tile_row + 1) << CANVAS_TILE_BITS
+            );
+            int right = SDL_min(
+                range->column + range->columns,
+                (tile_col + 1) << CANVAS_TILE_BITS
+            );
+
+            for (int row = top; row < bottom; ++row)
+            {
+                for (int col = left; col < right; ++col)
+                {
+                    // Values past the brush colors have nothing to show
+                    uint8_t value = tile->cells[canvas_tile_offset(row, col)];
+                    if (value == CANVAS_EMPTY || value > brush_colors->size)
+                        continue;
+
+                    SDL_Color color = brush_colors->colors[value - 1];
+
+                    SDL_Rect rect = view_cell_rect(view, row, col);
+
+                    SDL_SetRenderDrawColor(
+                        ren, color.r, color.g, color.b, color.a
+                    );
+                    SDL_RenderFillRect(ren, &rect);
+                }
+            }
+        }
+    }
+}
+
+void canvas_texture_free(CanvasTexture *texture)
+{
+    for (int i = 0; i < texture->tile_rows * texture->tile_columns; ++i)
+    {
+        if (texture->tiles[i] != NULL)
+            SDL_DestroyTexture(texture->tiles[i]);
+    }
+    free(texture->tiles);
+    free(texture->stale);
+    texture->tiles        = NULL;
+    texture->stale        = NULL;
+    texture->tile_rows    = 0;
+    texture->tile_columns = 0;
+}
+
+// Takes the tiles of `canvas` that changed since the last call, marking their
+// textures stale and dropping the textures of tiles that became empty. All
+// tiles go stale when the brush colors changed. Returns false if the tile
+// table could not be allocated.
+bool canvas_texture_update(
+    CanvasTexture *texture, Canvas *canvas, BrushColors *brush_colors
+)
+{
+    // ABGR8888 is the packed format whose texels match RGBA(), and empty
+    // cells stay transparent
+    Uint32 colors[256];
+    brush_colors_texels(brush_colors, colors);
+
+    int count = canvas->tile_rows * canvas->tile_columns;
+
+    if (texture->tiles == NULL || texture->tile_rows != canvas->tile_rows ||
+        texture->tile_columns != canvas->tile_columns)
+    {
+        canvas_texture_free(texture);
+        texture->tiles = calloc(count, sizeof(SDL_Texture *));
+        texture->stale = calloc(count, sizeof(Uint8));
+        if (texture->tiles == NULL || texture->stale == NULL)
+        {
+            free(texture->tiles);
+            free(texture->stale);
+            texture->tiles = NULL;
+            texture->stale = NULL;
+            return false;
+        }
+        texture->tile_rows    = canvas->tile_rows;
+        texture->tile_columns = canvas->tile_columns;
+    }
+
+    if (memcmp(colors, texture->colors, sizeof(colors)) != 0)
+    {
+        memcpy(texture->colors, colors, sizeof(colors));
+        memset(texture->stale, true, count);
+    }
+
+    if (canvas->dirty_count == 0)
+        return true;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!canvas->dirty[i])
+            continue;
+
+        if (canvas->data->tiles[i] != NULL)
+        {
+            texture->stale[i] = true;
+        }
+        else if (texture->tiles[i] != NULL)
+        {
+            SDL_DestroyTexture(texture->tiles[i]);
+            texture->tiles[i] = NULL;
+        }
+    }
+    canvas_clear_dirty(canvas);
+
+    return true;
+}
+
+// Texture of the resident tile at `tile_row`, `tile_column`, created or
+// uploaded first if needed. Returns NULL if it could not be written.
+SDL_Texture *canvas_texture_tile(
+    SDL_Renderer *ren,
+    CanvasTexture *texture,
+    Canvas *canvas,
+    int tile_row,
+    int tile_column
+)
+{
+    int index              = tile_row * texture->tile_columns + tile_column;
+    SDL_Texture **tile_tex = &texture->tiles[index];
+    const CanvasTile *tile = canvas_tile(canvas, tile_row, tile_column);
+
+    if (*tile_tex == NULL)
+    {
+        *tile_tex = SDL_CreateTexture(
+            ren,
+            SDL_PIXELFORMAT_ABGR8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            CANVAS_TILE_SIZE,
+            CANVAS_TILE_SIZE
+        );
+        if (*tile_tex == NULL)
+            return NULL;
+        SDL_SetTextureBlendMode(*tile_tex, SDL_BLENDMODE_BLEND);
+        texture->stale[index] = true;
+    }
+
+    if (!texture->stale[index])
+        return *tile_tex;
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(*tile_tex, NULL, &pixels, &pitch) != 0)
+    {
+        // Start over with a new texture next time
+        SDL_DestroyTexture(*tile_tex);
+        *tile_tex = NULL;
+        return NULL;
+    }
+
+    tile_texels(tile, texture->colors, pixels, pitch);
+    SDL_UnlockTexture(*tile_tex);
+    texture->stale[index] = false;
+
+    return *tile_tex;
+}
+
+// Draws the cells inside `area`, visiting only the tiles that are on screen
+// and have painted cells
+void draw_canvas(
+    SDL_Renderer *ren,
+    CanvasTexture *texture,
+    View *view,
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    SDL_Rect *area
+)
+{
+    bool textured = canvas_texture_update(texture, canvas, brush_colors);
+
+    CellRange range;
+    if (!view_visible_cells(view, *area, canvas->rows, canvas->columns, &range))
+        return;
+
+    if (!textured)
+    {
+        render_canvas(ren, view, canvas, brush_colors, &range);
+        return;
+    }
+
+    CellRange tiles = tiles_of_cells(&range);
+    for (int tile_row = tiles.row; tile_row < tiles.row + tiles.rows;
+         ++tile_row)
+    {
+        for (int tile_col = tiles.column;
+             tile_col < tiles.column + tiles.columns;
+             ++tile_col)
+        {
+            if (canvas_tile(canvas, tile_row, tile_col) == NULL)
+                continue;
+
+            SDL_Rect dst = view_cells_rect(
+                view,
+                tile_row << CANVAS_TILE_BITS,
+                tile_col << CANVAS_TILE_BITS,
+                CANVAS_TILE_SIZE,
+                CANVAS_TILE_SIZE
+            );
+            SDL_Texture *tile_tex = canvas_texture_tile(
+                ren, texture, canvas, tile_row, tile_col
+            );
+            if (tile_tex != NULL)
+            {
+                SDL_RenderCopy(ren, tile_tex, NULL, &dst);
+                continue;
+            }
+
+            CellRange cells = {
+                .row     = tile_row << CANVAS_TILE_BITS,
+                .column  = tile_col << CANVAS_TILE_BITS,
+                .rows    = CANVAS_TILE_SIZE,
+                .columns = CANVAS_TILE_SIZE
+            };
+            render_canvas(ren, view, canvas, brush_colors, &cells);
+        }
+    }
+}
+
+void make_file_name(char *file_name, size_t size)
+{
+    time_t t     = time(NULL);
+    struct tm tm = *localtime(&t);
+    snprintf(
+        file_name,
+        size,
+        "image-%i-%i:%i:%i.png",
+        tm.tm_mday,
+        tm.tm_hour,
+        tm.tm_min,
+        tm.tm_sec
+    );
+}
+
+typedef enum
+{
+    SAVE_IDLE,
+    SAVE_QUEUED,
+    SAVE_RUNNING,
+    SAVE_DONE,
+    SAVE_FAILED,
+} SaveState;
+
+// Kinds of save, each with its own waiting job
+typedef enum
+{
+    SAVE_JOB_IMAGE,
+    SAVE_JOB_PROJECT,
+    SAVE_JOB_KINDS,
+} SaveKind;
+
+typedef struct
+{
+    bool pending;
+    Canvas canvas;
+    BrushColors colors;
+    int cell_size;
+    char file_name[256];
+} SaveJob;
+
+// Saves images and projects on a worker thread. The UI thread hands over a
+// copy-on-write snapshot of the canvas, so queueing a save costs no more than
+// a refcount.
+typedef struct
+{
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool quit;
+
+    // Waiting job of each kind; a newer request replaces the one of its own
+    // kind only, so repeated saves coalesce without an image export dropping
+    // a project save or the other way round
+    SaveJob jobs[SAVE_JOB_KINDS];
+
+    // State of the most recent job, shown in the info bar
+    SaveState state;
+    char file_name[256];
+    atomic_int progress;
+
+    // Last save that failed, kept until a save of the same kind succeeds so
+    // the jobs queued behind it do not hide it. Empty if there is none.
+    char failed_file_name[256];
+    SaveKind failed_kind;
+} Saver;
+
+int saver_pending(Saver *saver)
+{
+    int pending = 0;
+    for (int i = 0; i < SAVE_JOB_KINDS; ++i)
+        pending += saver->jobs[i].pending;
+
+    return pending;
+}
+
+int saver_thread(void *data)
+{
+    Saver *saver = data;
+
+    SDL_LockMutex(saver->lock);
+    for (;;)
+    {
+        while (saver_pending(saver) == 0 && !saver->quit)
+            SDL_CondWait(saver->wake, saver->lock);
+
+        // Pending work is finished before quitting
+        if (saver_pending(saver) == 0)
+            break;
+
+        // A project holds the work itself, it goes before images
+        SaveKind kind = saver->jobs[SAVE_JOB_PROJECT].pending ? SAVE_JOB_PROJECT
+                                                              : SAVE_JOB_IMAGE;
+        SaveJob job   = saver->jobs[kind];
+        saver->jobs[kind].pending = false;
+        memcpy(saver->file_name, job.file_name, sizeof(saver->file_name));
+        saver->state = SAVE_RUNNING;
+        atomic_store(&saver->progress, 0);
+        SDL_UnlockMutex(saver->lock);
+
+        bool ok;
+        if (kind == SAVE_JOB_PROJECT)
+        {
+            ProjectInfo info;
+            project_info(&job.colors, job.cell_size, &info);
+            ok = project_save(job.file_name, &job.canvas, &info);
+        }
+        else
+        {
+            ok = save_as_png(
+                &job.canvas,
+                &job.colors,
+                job.cell_size,
+                job.file_name,
+                &saver->progress
+            );
+        }
+        canvas_free(&job.canvas);
+
+        SDL_LockMutex(saver->lock);
+        if (!ok)
+        {
+            memcpy(
+                saver->failed_file_name,
+                job.file_name,
+                sizeof(saver->failed_file_name)
+            );
+            saver->failed_kind = kind;
+        }
+        else if (saver->failed_kind == kind)
         {
-            brush_colors->selected = i;
+            saver->failed_file_name[0] = '\0';
         }
 
-        x += padding + CELL_SIZE;
+        if (saver_pending(saver) > 0)
+            saver->state = SAVE_QUEUED;
+        else
+            saver->state = ok ? SAVE_DONE : SAVE_FAILED;
     }
+    SDL_UnlockMutex(saver->lock);
+
+    return 0;
 }
 
-void draw_info(
-    SDL_Renderer *ren,
-    TTF_Font *font,
-    Cells *cells,
-    int points_size,
-    int mouse_x,
-    int mouse_y
-)
+bool saver_start(Saver *saver)
 {
-    int padding = 10;
-    int x       = 5;
-    int y       = CELL_SIZE + padding * 2;
+    *saver = (Saver){.state = SAVE_IDLE};
+    atomic_init(&saver->progress, 0);
 
-    {
-        char *text = malloc(50 * sizeof(char));
-        sprintf(text, "rows/columns: %i/%i", cells->size.h, cells->size.w);
+    saver->lock = SDL_CreateMutex();
+    saver->wake = SDL_CreateCond();
+    if (saver->lock == NULL || saver->wake == NULL)
+        return false;
 
-        SDL_Surface *surface =
-            TTF_RenderText_Blended(font, text, (SDL_Color){255, 255, 255, 255});
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(ren, surface);
+    saver->thread = SDL_CreateThread(saver_thread, "saver", saver);
+    return saver->thread != NULL;
+}
 
-        SDL_Rect rect = {.x = x, .y = y, .w = surface->w, .h = surface->h};
+// Waits for queued and running saves to finish
+void saver_stop(Saver *saver)
+{
+    SDL_LockMutex(saver->lock);
+    saver->quit = true;
+    SDL_CondSignal(saver->wake);
+    SDL_UnlockMutex(saver->lock);
+
+    SDL_WaitThread(saver->thread, NULL);
+    SDL_DestroyCond(saver->wake);
+    SDL_DestroyMutex(saver->lock);
+}
 
-        SDL_RenderCopy(ren, texture, NULL, &rect);
+// Queues a save of `canvas` to the project file `project`, or to a new image
+// if `project` is NULL
+void saver_request(
+    Saver *saver,
+    Canvas *canvas,
+    BrushColors *brush_colors,
+    int cell_size,
+    const char *project
+)
+{
+    SDL_LockMutex(saver->lock);
+    SaveJob *job = &saver->jobs[project != NULL ? SAVE_JOB_PROJECT
+                                                : SAVE_JOB_IMAGE];
+    if (job->pending)
+        canvas_free(&job->canvas);
+
+    canvas_snapshot(canvas, &job->canvas);
+    job->colors    = *brush_colors;
+    job->cell_size = cell_size;
+    if (project != NULL)
+        snprintf(job->file_name, sizeof(job->file_name), "%s", project);
+    else
+        make_file_name(job->file_name, sizeof(job->file_name));
+    job->pending = true;
+    if (saver->state != SAVE_RUNNING)
+    {
+        saver->state = SAVE_QUEUED;
+        memcpy(saver->file_name, job->file_name, sizeof(saver->file_name));
+    }
 
-        SDL_SetRenderDrawColor(ren, BACKGROUND_COLOR);
-        SDL_RenderDrawRect(ren, &rect);
+    SDL_CondSignal(saver->wake);
+    SDL_UnlockMutex(saver->lock);
+}
 
-        x += surface->w + padding;
+bool saver_busy(Saver *saver)
+{
+    SDL_LockMutex(saver->lock);
+    bool busy = saver->state == SAVE_QUEUED || saver->state == SAVE_RUNNING;
+    SDL_UnlockMutex(saver->lock);
 
-        free(surface);
-        SDL_DestroyTexture(texture);
+    return busy;
+}
 
-        free(text);
+// Describes the most recent save for the info bar, empty when there is none
+void saver_status(Saver *saver, char *text, size_t size)
+{
+    SDL_LockMutex(saver->lock);
+    switch (saver->state)
+    {
+        case SAVE_IDLE:
+            text[0] = '\0';
+            break;
+        case SAVE_QUEUED:
+            snprintf(text, size, "Queued %s", saver->file_name);
+            break;
+        case SAVE_RUNNING:
+            snprintf(
+                text,
+                size,
+                "Saving %s %i%%",
+                saver->file_name,
+                atomic_load(&saver->progress)
+            );
+            if (saver_pending(saver) > 0)
+            {
+                size_t length = strlen(text);
+                snprintf(
+                    text + length,
+                    size - length,
+                    " (+%i queued)",
+                    saver_pending(saver)
+                );
+            }
+            break;
+        case SAVE_DONE:
+            snprintf(text, size, "Saved %s", saver->file_name);
+            break;
+        case SAVE_FAILED:
+            snprintf(text, size, "Failed to save %s", saver->file_name);
+            break;
     }
 
+    // An earlier failure stays visible behind the saves that followed it
+    if (saver->failed_file_name[0] != '\0' && saver->state != SAVE_FAILED)
     {
-        char *text = malloc(50 * sizeof(char));
-        sprintf(text, "Total points: %i", points_size);
+        size_t length = strlen(text);
+        snprintf(
+            text + length,
+            size - length,
+            "%sFailed to save %s",
+            length > 0 ? ", " : "",
+            saver->failed_file_name
+        );
+    }
+    SDL_UnlockMutex(saver->lock);
+}
 
-        SDL_Surface *surface =
-            TTF_RenderText_Blended(font, text, (SDL_Color){255, 255, 255, 255});
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(ren, surface);
+// Ctrl+arrow keys add or remove a row or column at the bottom or right edge.
+// Returns true if the canvas was resized.
+bool resize_canvas_by_key(Canvas *canvas, SDL_Keycode key)
+{
+    int rows    = canvas->rows;
+    int columns = canvas->columns;
+    switch (key)
+    {
+        case SDLK_DOWN:
+            rows++;
+            break;
+        case SDLK_UP:
+            rows--;
+            break;
+        case SDLK_RIGHT:
+            columns++;
+            break;
+        case SDLK_LEFT:
+            columns--;
+            break;
+        default:
+            return false;
+    }
 
-        SDL_Rect rect = {.x = x, .y = y, .w = surface->w, .h = surface->h};
+    if (rows < 1 || rows > CANVAS_MAX_SIZE || columns < 1 ||
+        columns > CANVAS_MAX_SIZE)
+    {
+        return false;
+    }
 
-        SDL_RenderCopy(ren, texture, NULL, &rect);
+    if (!canvas_resize(canvas, rows, columns))
+    {
+        fprintf(
+            stderr, "ERROR: Failed to resize canvas to %ix%i\n", columns, rows
+        );
+        return false;
+    }
 
-        SDL_SetRenderDrawColor(ren, BACKGROUND_COLOR);
-        SDL_RenderDrawRect(ren, &rect);
+    return true;
+}
 
-        x += surface->w + padding;
+typedef struct
+{
+    int rows;
+    int columns;
+    int cell_size;
+    // Upper limit of rendered frames per second, 0 for none
+    int fps_cap;
+    bool vsync;
+    // Undo memory budget in megabytes
+    int history_size;
+    // Project file to open and save to, NULL for DEFAULT_PROJECT
+    const char *project;
+    // PNG image painted onto the canvas at startup, one cell per `block` by
+    // `block` pixels
+    const char *import;
+    int block;
+    // The canvas size was given, rather than taken from the image
+    bool sized;
+    // Input log to write the session to, or to replay instead of live input
+    const char *record;
+    const char *replay;
+    // Replay as fast as possible rather than at the recorded pace
+    bool fast;
+    bool render;
+} Options;
+
+void print_usage(const char *program)
+{
+    fprintf(
+        stderr,
+        "Usage: %s [options] [FILE]\n"
+        "       %s --batch [options] JOB...   run jobs without a window\n"
+        "  FILE        project to open, and save to with Ctrl+S (default %s)\n"
+        "  --size WxH  canvas of W columns and H rows (default %ix%i)\n"
+        "  --cell N    cell size in pixels (default %i)\n"
+        "  --fps N     render at most N frames per second\n"
+        "  --vsync     wait for vertical sync when presenting frames\n"
+        "  --history N keep up to N megabytes of undo history (default %i)\n"
+        "  --import F  paint the PNG image F onto the canvas\n"
+        "  --block N   one cell per NxN pixels of the imported image\n"
+        "  --record F  write the input of the session to F\n"
+        "  --replay F  replay the input recorded in F at its recorded pace\n"
+        "  --fast      replay as fast as possible\n"
+        "  --no-render replay without drawing frames\n",
+        program,
+        program,
+        DEFAULT_PROJECT,
+        DEFAULT_COLUMNS,
+        DEFAULT_ROWS,
+        DEFAULT_CELL_SIZE,
+        DEFAULT_HISTORY_SIZE
+    );
+}
 
-        free(surface);
-        SDL_DestroyTexture(texture);
+// Parses a decimal number in [min, max]. Returns false if `text` is not one.
+bool parse_int(const char *text, int min, int max, int *value, char **end)
+{
+    char *stop;
+    long number = strtol(text, &stop, 10);
+    if (stop == text || number < min || number > max)
+        return false;
+
+    *value = (int)number;
+    if (end != NULL)
+        *end = stop;
+    return end != NULL || *stop == '\0';
+}
 
-        free(text);
-    }
+bool parse_options(int argc, char **argv, Options *options)
+{
+    *options = (Options){
+        .rows         = DEFAULT_ROWS,
+        .columns      = DEFAULT_COLUMNS,
+        .cell_size    = DEFAULT_CELL_SIZE,
+        .fps_cap      = 0,
+        .vsync        = false,
+        .history_size = DEFAULT_HISTORY_SIZE,
+        .project      = NULL,
+        .import       = NULL,
+        .block        = 1,
+        .sized        = false,
+        .record       = NULL,
+        .replay       = NULL,
+        .fast         = false,
+        .render       = true
+    };
 
+    for (int i = 1; i < argc; ++i)
     {
-        char *text = malloc(50 * sizeof(char));
-        sprintf(text, "%ix%i", mouse_x, mouse_y);
-
-        SDL_Surface *surface =
-            TTF_RenderText_Blended(font, text, (SDL_Color){255, 255, 255, 255});
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(ren, surface);
-
-        SDL_Rect rect = {.x = x, .y = y, .w = surface->w, .h = surface->h};
+        if (strcmp(argv[i], "--vsync") == 0)
+        {
+            options->vsync = true;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+        {
+            if (!parse_int(argv[++i], 0, 1000, &options->fps_cap, NULL))
+            {
+                fprintf(stderr, "ERROR: Invalid frame cap '%s'\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            const char *size = argv[++i];
+            char *end;
+            if (!parse_int(
+                    size, 1, CANVAS_MAX_SIZE, &options->columns, &end
+                ) ||
+                *end != 'x' ||
+                !parse_int(end + 1, 1, CANVAS_MAX_SIZE, &options->rows, NULL))
+            {
+                fprintf(stderr, "ERROR: Invalid canvas size '%s'\n", size);
+                return false;
+            }
+            options->sized = true;
+        }
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc)
+        {
+            if (!parse_int(
+                    argv[++i],
+                    0,
+                    MAX_HISTORY_SIZE,
+                    &options->history_size,
+                    NULL
+                ))
+            {
+                fprintf(stderr, "ERROR: Invalid history size '%s'\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--cell") == 0 && i + 1 < argc)
+        {
+            if (!parse_int(
+                    argv[++i],
+                    MIN_CELL_SIZE,
+                    MAX_CELL_SIZE,
+                    &options->cell_size,
+                    NULL
+                ))
+            {
+                fprintf(stderr, "ERROR: Invalid cell size '%s'\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc)
+        {
+            options->import = argv[++i];
+        }
+        else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc)
+        {
+            if (!parse_int(
+                    argv[++i], 1, IMPORT_MAX_BLOCK, &options->block, NULL
+                ))
+            {
+                fprintf(stderr, "ERROR: Invalid block size '%s'\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            options->record = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            options->replay = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fast") == 0)
+        {
+            options->fast = true;
+        }
+        else if (strcmp(argv[i], "--no-render") == 0)
+        {
+            options->render = false;
+        }
+        else if (argv[i][0] != '-' && options->project == NULL)
+        {
+            options->project = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: Unknown option '%s'\n", argv[i]);
+            return false;
+        }
+    }
 
-        SDL_RenderCopy(ren, texture, NULL, &rect);
+    if ((options->fast || !options->render) && options->replay == NULL)
+    {
+        fprintf(stderr, "ERROR: --fast and --no-render need --replay\n");
+        return false;
+    }
 
-        SDL_SetRenderDrawColor(ren, BACKGROUND_COLOR);
-        SDL_RenderDrawRect(ren, &rect);
+    return true;
+}
 
-        x += surface->w + padding;
+// Initial window size, big enough for the whole canvas if the screen allows
+void window_size(Options *options, int *width, int *height)
+{
+    long w = GRID_MIN_WIDTH + (long)options->columns * options->cell_size;
+    long h = GRID_MIN_HEIGHT + (long)options->rows * options->cell_size;
+
+    if (w < MIN_WINDOW_WIDTH)
+        w = MIN_WINDOW_WIDTH;
+    if (w > MAX_WINDOW_WIDTH)
+        w = MAX_WINDOW_WIDTH;
+    if (h < MIN_WINDOW_HEIGHT)
+        h = MIN_WINDOW_HEIGHT;
+    if (h > MAX_WINDOW_HEIGHT)
+        h = MAX_WINDOW_HEIGHT;
+
+    *width  = (int)w;
+    *height = (int)h;
+}
 
-        free(surface);
-        SDL_DestroyTexture(texture);
+const char *tool_name(Tool tool, FillMode fill_mode)
+{
+    if (tool == TOOL_BRUSH)
+        return "Brush";
+    if (tool == TOOL_SELECT)
+        return "Select";
 
-        free(text);
+    switch (fill_mode)
+    {
+        case FILL_CONNECTED_4:
+            return "Fill";
+        case FILL_CONNECTED_8:
+            return "Fill (diagonal)";
+        case FILL_REPLACE:
+            return "Replace color";
     }
+
+    return "";
 }
 
-void save_as_png(Point **points, int points_size)
+// Zoom level one step in `direction` (positive to zoom in) from `zoom`. Whole
+// steps go through integer multiples of the cell size, and halve or double
+// the zoom below 1x. Other steps change it by a quarter.
+int zoom_step(int zoom, int direction, bool whole)
 {
-    char *file_name = malloc(128 * sizeof(char));
+    int next;
+    if (!whole)
+        next = direction > 0 ? zoom * 5 / 4 : zoom * 4 / 5;
+    else if (direction > 0)
+        next = zoom < VIEW_SCALE_ONE
+                   ? zoom * 2
+                   : (zoom / VIEW_SCALE_ONE + 1) * VIEW_SCALE_ONE;
+    else
+        next = zoom <= VIEW_SCALE_ONE
+                   ? zoom / 2
+                   : (zoom - 1) / VIEW_SCALE_ONE * VIEW_SCALE_ONE;
+
+    if (next < MIN_ZOOM)
+        next = MIN_ZOOM;
+    if (next > MAX_ZOOM)
+        next = MAX_ZOOM;
+
+    return next;
+}
 
-    time_t t     = time(NULL);
-    struct tm tm = *localtime(&t);
-    sprintf(
-        file_name,
-        "image-%i-%i:%i:%i.png",
-        tm.tm_mday,
-        tm.tm_hour,
-        tm.tm_min,
-        tm.tm_sec
-    );
-    printf("Saving image to '%s'\n", file_name);
+// Part of the window the canvas is drawn in, below the top bar
+SDL_Rect canvas_area(SDL_Renderer *ren)
+{
+    int width, height;
+    SDL_GetRendererOutputSize(ren, &width, &height);
+
+    return (SDL_Rect){
+        .x = GRID_MIN_WIDTH,
+        .y = GRID_MIN_HEIGHT,
+        .w = width - GRID_MIN_WIDTH,
+        .h = height - GRID_MIN_HEIGHT
+    };
+}
 
-    int width  = GRID_MAX_WIDTH;
-    int height = GRID_MAX_HEIGHT;
+int main(int argc, char **argv)
+{
+    // Batch jobs need no window, leave SDL video alone
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return batch_main(argc - 2, argv + 2);
 
-    libattopng_t *png = libattopng_new(width, height, PNG_RGBA);
+    Options options;
+    if (!parse_options(argc, argv, &options))
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
 
-    int x, y;
-    for (y = 0; y < height; ++y)
+    // An existing project decides the canvas and cell size before the window
+    // is sized for them
+    Canvas loaded       = {.data = NULL};
+    ProjectInfo project = {.color_count = 0};
+    const char *project_file =
+        options.project != NULL ? options.project : DEFAULT_PROJECT;
+    if (options.project != NULL && access(options.project, F_OK) == 0)
     {
-        for (x = 0; x < width; ++x)
+        if (!project_load(options.project, &loaded, &project))
+            exit(1);
+
+        if (loaded.rows > CANVAS_MAX_SIZE || loaded.columns > CANVAS_MAX_SIZE)
         {
-            bool pixel_not_empty = false;
-            for (int i = 0; i < points_size; ++i)
-            {
-                Point *point = points[i];
-                if ((point->x >= x && point->x <= x + CELL_SIZE) &&
-                    (point->y >= y && point->y <= y + CELL_SIZE))
-                {
-                    libattopng_set_pixel(
-                        png,
-                        x,
-                        y,
-                        RGBA(
-                            point->color.r,
-                            point->color.g,
-                            point->color.b,
-                            point->color.a
-                        )
-                    );
+            fprintf(
+                stderr,
+                "ERROR: Canvas of '%s' is larger than %ix%i\n",
+                options.project,
+                CANVAS_MAX_SIZE,
+                CANVAS_MAX_SIZE
+            );
+            exit(1);
+        }
+        options.rows      = loaded.rows;
+        options.columns   = loaded.columns;
+        options.cell_size = SDL_max(
+            MIN_CELL_SIZE, SDL_min(project.cell_size, MAX_CELL_SIZE)
+        );
+        options.sized = true;
+    }
 
-                    pixel_not_empty = true;
-                }
-            }
+    // Without a size, the canvas fits the imported image
+    PngReader image = {.stream = NULL};
+    if (options.import != NULL)
+    {
+        if (!png_open(&image, options.import))
+            exit(1);
 
-            if (!pixel_not_empty)
-            {
-                libattopng_set_pixel(png, x, y, RGBA(28, 28, 28, 255));
-            }
+        if (!options.sized)
+        {
+            int rows    = (image.height + options.block - 1) / options.block;
+            int columns = (image.width + options.block - 1) / options.block;
+            options.rows    = SDL_min(rows, CANVAS_MAX_SIZE);
+            options.columns = SDL_min(columns, CANVAS_MAX_SIZE);
         }
     }
 
-    libattopng_save(png, file_name);
-    libattopng_destroy(png);
-    free(file_name);
-}
-
-int main()
-{
     srand(time(0));
 
     if (SDL_Init(SDL_INIT_VIDEO) == -1)
@@ -342,15 +1717,27 @@ int main()
         exit(1);
     }
 
+    int width, height;
+    window_size(&options, &width, &height);
+
+    // A replay that draws nothing has no use for a visible window
+    Uint32 window_flags = SDL_WINDOW_RESIZABLE;
+    window_flags |= options.render ? SDL_WINDOW_SHOWN : SDL_WINDOW_HIDDEN;
+
     SDL_Window *win =
-        SDL_CreateWindow("Grid", 0, 0, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
+        SDL_CreateWindow("Grid", 0, 0, width, height, window_flags);
     if (win == NULL)
     {
         fprintf(stderr, "ERROR: Failed to create window: %s", SDL_GetError());
         exit(1);
     }
 
-    SDL_Renderer *ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
+    Uint32 renderer_flags = SDL_RENDERER_ACCELERATED |
+                            SDL_RENDERER_TARGETTEXTURE;
+    if (options.vsync)
+        renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+
+    SDL_Renderer *ren = SDL_CreateRenderer(win, -1, renderer_flags);
     if (ren == NULL)
     {
         fprintf(stderr, "ERROR: Failed to create renderer: %s", SDL_GetError());
@@ -375,62 +1762,327 @@ int main()
     bool is_running = true;
     SDL_Event event;
 
-    Cells cells = {.size = 0};
-    build_grid(&cells);
+    // Pixels per cell in saved images, and on screen at a zoom of 1x
+    int cell_size = options.cell_size;
+    int zoom      = VIEW_SCALE_ONE;
 
-    Point **points  = malloc(MAX_CELLS * sizeof(Point));
-    int points_size = 0;
+    View view = view_at(GRID_MIN_WIDTH, GRID_MIN_HEIGHT, cell_size);
+    GridTexture grid = {.texture = NULL};
 
-    CursorBrush cursor_brush = {
-        .grid_pos =
-            {.row    = GRID_MIN_HEIGHT / CELL_SIZE,
-                       .column = GRID_MIN_WIDTH / CELL_SIZE}
-    };
+    Canvas canvas = loaded;
+    if (canvas.data == NULL &&
+        !canvas_init(&canvas, options.rows, options.columns))
+    {
+        fprintf(stderr, "ERROR: Failed to allocate canvas");
+        exit(1);
+    }
+
+    CanvasTexture canvas_texture = {.tiles = NULL};
+    InfoBar info                 = {.grid_size = {.texture = NULL}};
+
+    History history;
+    history_init(&history, (size_t)options.history_size << 20);
+
+    Saver saver;
+    if (!saver_start(&saver))
+    {
+        fprintf(stderr, "ERROR: Failed to start saver: %s", SDL_GetError());
+        exit(1);
+    }
+
+    CursorBrush cursor_brush = {.grid_pos = {.row = 0, .column = 0}};
+    Stroke stroke            = {.active = false};
+    Tool tool                = TOOL_BRUSH;
+    FillMode fill_mode       = FILL_CONNECTED_4;
+    Selection selection      = {.active = false};
+    Clipboard clipboard      = {.cells = NULL};
+
+    BrushColors brush_colors;
+    brush_colors_default(&brush_colors);
+    if (project.color_count > 0)
+        brush_colors_load(&brush_colors, &project);
 
-    BrushColors brush_colors = {.size = 0, .selected = 0};
-
-    ADD_COLOR(255, 255, 255)
-    ADD_COLOR(101, 101, 101)
-    ADD_COLOR(20, 20, 20)
-    ADD_COLOR(243, 46, 50)
-    ADD_COLOR(243, 242, 46)
-    ADD_COLOR(105, 243, 46)
-    ADD_COLOR(46, 243, 101)
-    ADD_COLOR(46, 243, 234)
-    ADD_COLOR(46, 151, 243)
-    ADD_COLOR(46, 88, 243)
-    ADD_COLOR(52, 46, 243)
-    ADD_COLOR(77, 46, 243)
-    ADD_COLOR(134, 46, 243)
-    ADD_COLOR(193, 46, 243)
-    ADD_COLOR(243, 46, 226)
-    ADD_COLOR(243, 46, 145)
+    if (image.stream != NULL)
+    {
+        ProjectInfo palette;
+        project_info(&brush_colors, cell_size, &palette);
+
+        // The import can be undone like any other edit
+        history_begin(&history);
+        bool imported = import_png(
+            &canvas,
+            &history,
+            &image,
+            (const uint8_t(*)[4])palette.colors,
+            palette.color_count,
+            options.block
+        );
+        history_end(&history);
+        png_close(&image);
+        if (!imported)
+            exit(1);
+    }
 
     /*
-    for (int i = 0; i < cells.size.w; i++)
+    for (int i = 0; i < canvas.columns; i++)
     {
-        for (int j = 0; j < cells.size.h; j++)
+        for (int j = 0; j < canvas.rows; j++)
         {
-            Cell cell             = cells.grid[j][i];
             brush_colors.selected = rand() % (brush_colors.size - 1 - 0);
-            save_point(points, &points_size, &brush_colors, cell.x, cell.y);
+            save_point(&canvas, &history, &brush_colors, j, i);
         }
     }
     brush_colors.selected = 0;
     */
 
+    // The session starts once the canvas is loaded and imported. A replay
+    // only gives the same result from the same start.
+    InputState input     = {.x = 0, .y = 0, .buttons = 0, .mod = KMOD_NONE};
+    InputSession session = {
+        .rows      = canvas.rows,
+        .columns   = canvas.columns,
+        .cell_size = cell_size
+    };
+    SDL_GetWindowSize(win, &session.window_width, &session.window_height);
+
+    InputRecorder recorder = {.file = NULL};
+    if (options.record != NULL &&
+        !input_record_open(&recorder, options.record, &session))
+    {
+        exit(1);
+    }
+
+    InputReplay replay = {.data = NULL};
+    if (options.replay != NULL)
+    {
+        InputSession recorded;
+        if (!input_replay_open(
+                &replay, options.replay, win, &recorded, !options.fast
+            ))
+        {
+            exit(1);
+        }
+        if (recorded.rows != session.rows ||
+            recorded.columns != session.columns ||
+            recorded.cell_size != session.cell_size)
+        {
+            fprintf(
+                stderr,
+                "ERROR: '%s' was recorded on a %ix%i canvas with a cell size "
+                "of %i\n",
+                options.replay,
+                recorded.columns,
+                recorded.rows,
+                recorded.cell_size
+            );
+            exit(1);
+        }
+    }
+    Uint64 session_start = SDL_GetPerformanceCounter();
+
+    // Frames are rendered only after something changed; the loop sleeps in
+    // between. A fast replay renders after every group of events, as the
+    // recorded session did, whatever the frame cap.
+    bool damaged           = true;
+    Uint32 frame_ms        = options.fps_cap > 0 && !options.fast
+                                 ? 1000 / options.fps_cap
+                                 : 0;
+    Uint32 last_frame      = 0;
+    int frames_rendered    = 0;
+    // Frames the frame cap held back, each counted once however many wake
+    // ups pass until it is rendered
+    int frames_skipped     = 0;
+    bool frame_held        = false;
+    // Frames of a replay without rendering
+    int frames_undrawn     = 0;
+    char shown_status[192] = "";
+
     while (is_running)
     {
-        while (SDL_PollEvent(&event))
+        // A frame held back by the frame cap and the progress of a running
+        // save need a wake up, anything else arrives as an event
+        int timeout = -1;
+        if (damaged)
+        {
+            Uint32 elapsed = SDL_GetTicks() - last_frame;
+            timeout        = elapsed < frame_ms ? (int)(frame_ms - elapsed) : 0;
+        }
+        else if (saver_busy(&saver))
+        {
+            timeout = SAVE_STATUS_INTERVAL;
+        }
+
+        bool has_event = options.replay != NULL
+                             ? input_replay_wait(&replay, &event, timeout)
+                             : SDL_WaitEventTimeout(&event, timeout);
+        while (has_event)
         {
+            damaged = true;
+            input_track(&input, &event);
+            if (options.record != NULL)
+                input_record(&recorder, &event);
+
             switch (event.type)
             {
                 case SDL_QUIT:
                     is_running = false;
                     break;
+                case SDL_MOUSEBUTTONDOWN:
+                {
+                    // Swatches are picked on the press itself, so no click is
+                    // lost when frames are skipped or not drawn
+                    SDL_Point point = {event.button.x, event.button.y};
+                    int block       = color_block_at(&brush_colors, point);
+                    if (block >= 0)
+                    {
+                        if (event.button.button == SDL_BUTTON_LEFT)
+                            brush_colors.selected = block;
+                        break;
+                    }
+
+                    // Cells panned under the top bar cannot be painted
+                    SDL_Rect area = canvas_area(ren);
+                    if (!SDL_PointInRect(&point, &area))
+                        break;
+
+                    switch (tool)
+                    {
+                        case TOOL_BRUSH:
+                            stroke_press(
+                                &stroke,
+                                &canvas,
+                                &history,
+                                &brush_colors,
+                                &view,
+                                &event.button
+                            );
+                            break;
+                        case TOOL_FILL:
+                            fill_press(
+                                &canvas,
+                                &history,
+                                &brush_colors,
+                                &view,
+                                fill_mode,
+                                &event.button
+                            );
+                            break;
+                        case TOOL_SELECT:
+                            selection_press(
+                                &selection, &canvas, &view, &event.button
+                            );
+                            break;
+                    }
+                    break;
+                }
+                case SDL_MOUSEBUTTONUP:
+                    if (event.button.button == SDL_BUTTON_LEFT)
+                    {
+                        // Events after the release must not change how the
+                        // rest of the stroke is painted
+                        stroke_flush(&stroke, &canvas, &history, &brush_colors);
+                        history_end(&history);
+                        stroke.active = false;
+                    }
+                    selection_release(
+                        &selection, &canvas, &history, &event.button
+                    );
+                    break;
+                case SDL_MOUSEMOTION:
+                    if ((event.motion.state & SDL_BUTTON_MMASK) != 0)
+                    {
+                        view.x += event.motion.xrel;
+                        view.y += event.motion.yrel;
+                    }
+                    stroke_motion(
+                        &stroke,
+                        &canvas,
+                        &history,
+                        &brush_colors,
+                        &view,
+                        &event.motion
+                    );
+                    selection_motion(
+                        &selection, &canvas, &view, &event.motion
+                    );
+                    break;
+                case SDL_MOUSEWHEEL:
+                {
+                    int steps = event.wheel.y;
+                    if (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED)
+                        steps = -steps;
+
+                    bool whole = (input.mod & KMOD_CTRL) != 0;
+                    for (; steps > 0; --steps)
+                        zoom = zoom_step(zoom, 1, whole);
+                    for (; steps < 0; ++steps)
+                        zoom = zoom_step(zoom, -1, whole);
+
+                    view_zoom_at(&view, cell_size * zoom, input.x, input.y);
+                    break;
+                }
+                case SDL_RENDER_TARGETS_RESET:
+                    // Target texture contents are lost, render them again
+                    grid_texture_free(&grid);
+                    break;
+                case SDL_RENDER_DEVICE_RESET:
+                    // All textures are lost
+                    grid_texture_free(&grid);
+                    canvas_texture_free(&canvas_texture);
+                    info_bar_free(&info);
+                    break;
                 case SDL_KEYDOWN:
-                    if (event.key.keysym.sym == 'c')
-                        points_size = 0;
+                {
+                    // Samples of the stroke so far are painted before the
+                    // key acts, as they were drawn before it was pressed
+                    stroke_flush(&stroke, &canvas, &history, &brush_colors);
+
+                    bool ctrl = (event.key.keysym.mod & KMOD_CTRL) != 0;
+
+                    GridPos cursor;
+                    view_screen_to_cell(
+                        &view, input.x, input.y, &cursor.row, &cursor.column
+                    );
+                    if (selection_key(
+                            &selection,
+                            &clipboard,
+                            &canvas,
+                            &history,
+                            &brush_colors,
+                            cursor,
+                            &event.key.keysym
+                        ))
+                    {
+                        break;
+                    }
+
+                    if (event.key.keysym.sym == 'c' && !ctrl)
+                        history_clear_canvas(&history, &canvas);
+                    if (event.key.keysym.sym == 'b' && !ctrl)
+                        tool = TOOL_BRUSH;
+                    if (event.key.keysym.sym == 'm' && !ctrl)
+                        tool = TOOL_SELECT;
+                    if (event.key.keysym.sym == 'f' && !ctrl)
+                    {
+                        // Picking the fill tool again goes to its next mode
+                        if (tool == TOOL_FILL)
+                            fill_mode = (fill_mode + 1) % (FILL_REPLACE + 1);
+                        tool = TOOL_FILL;
+                    }
+                    if (ctrl && (event.key.keysym.sym == 'z' ||
+                                 event.key.keysym.sym == 'y'))
+                    {
+                        // A stroke in progress ends here, so it is undone
+                        // as a whole
+                        stroke.active = false;
+
+                        bool redo = event.key.keysym.sym == 'y' ||
+                                    (event.key.keysym.mod & KMOD_SHIFT) != 0;
+                        if (redo)
+                            history_redo(&history, &canvas);
+                        else
+                            history_undo(&history, &canvas);
+                    }
                     if (event.key.keysym.sym == 'p')
                     {
                         if (brush_colors.selected == 0)
@@ -455,89 +2107,172 @@ int main()
                     }
                     if (event.key.keysym.sym == 's')
                     {
-                        save_as_png(points, points_size);
+                        saver_request(
+                            &saver,
+                            &canvas,
+                            &brush_colors,
+                            cell_size,
+                            ctrl ? project_file : NULL
+                        );
+                    }
+                    if (event.key.keysym.sym == ']' &&
+                        cell_size < MAX_CELL_SIZE)
+                    {
+                        cell_size++;
+                    }
+                    if (event.key.keysym.sym == '[' &&
+                        cell_size > MIN_CELL_SIZE)
+                    {
+                        cell_size--;
+                    }
+                    if (event.key.keysym.sym == '0')
+                    {
+                        // Back to the initial zoom and position
+                        zoom = VIEW_SCALE_ONE;
+                        view = view_at(GRID_MIN_WIDTH, GRID_MIN_HEIGHT, 1);
+                    }
+                    view_zoom_at(
+                        &view, cell_size * zoom, GRID_MIN_WIDTH, GRID_MIN_HEIGHT
+                    );
+                    if (ctrl &&
+                        resize_canvas_by_key(&canvas, event.key.keysym.sym))
+                    {
+                        // Recorded cells may no longer exist
+                        history_clear(&history);
+                        selection.active =
+                            selection_clip(&canvas, &selection.range);
                     }
                     break;
+                }
             }
+
+            has_event = options.replay != NULL
+                            ? input_replay_poll(&replay, &event)
+                            : SDL_PollEvent(&event);
         }
+        stroke_flush(&stroke, &canvas, &history, &brush_colors);
+
+        char save_status[192];
+        saver_status(&saver, save_status, sizeof(save_status));
+        if (strcmp(save_status, shown_status) != 0)
+            damaged = true;
 
-        int mouse_x, mouse_y;
-        Uint32 buttons   = SDL_GetMouseState(&mouse_x, &mouse_y);
-        SDL_Point cursor = {mouse_x, mouse_y};
+        if (!damaged)
+            continue;
 
-        for (int col = 0; col < cells.size.w; ++col)
+        if (SDL_GetTicks() - last_frame < frame_ms)
         {
-            for (int row = 0; row < cells.size.h; ++row)
-            {
-                Cell cell = cells.grid[row][col];
+            if (!frame_held)
+                frames_skipped++;
+            frame_held = true;
+            continue;
+        }
+        frame_held = false;
 
-                SDL_Rect rect = {
-                    .x = cell.x, .y = cell.y, .w = CELL_SIZE, .h = CELL_SIZE
-                };
+        // Events held back by the frame cap join the group of this frame
+        if (options.record != NULL)
+            input_record_sync(&recorder);
 
-                if (SDL_PointInRect(&cursor, &rect) &&
-                    (buttons & SDL_BUTTON_LMASK) != 0)
-                {
-                    save_point(
-                        points, &points_size, &brush_colors, cell.x, cell.y
-                    );
-                    cursor_brush.grid_pos.row    = cell.y / CELL_SIZE;
-                    cursor_brush.grid_pos.column = cell.x / CELL_SIZE;
-                }
-                else if (SDL_PointInRect(&cursor, &rect))
-                {
-                    // Follow mouse cursor
-                    cursor_brush.grid_pos.row    = cell.y / CELL_SIZE;
-                    cursor_brush.grid_pos.column = cell.x / CELL_SIZE;
-                }
-            }
+        if (!options.render)
+        {
+            // The frame is counted, but not drawn
+            memcpy(shown_status, save_status, sizeof(shown_status));
+            damaged = false;
+            frames_undrawn++;
+            continue;
+        }
+
+        int mouse_x = input.x;
+        int mouse_y = input.y;
+
+        int row, col;
+        view_screen_to_cell(&view, mouse_x, mouse_y, &row, &col);
+        if (canvas_contains(&canvas, row, col))
+        {
+            // Follow mouse cursor
+            cursor_brush.grid_pos.row    = row;
+            cursor_brush.grid_pos.column = col;
         }
 
         SDL_SetRenderDrawColor(ren, BACKGROUND_COLOR);
         SDL_RenderClear(ren);
 
-        draw_grid(ren, &cells);
-
-        draw_color_blocks(ren, &brush_colors, buttons, cursor);
-        draw_info(ren, font, &cells, points_size, mouse_x, mouse_y);
+        draw_color_blocks(ren, &brush_colors);
+        draw_info(
+            ren,
+            font,
+            &info,
+            &canvas,
+            zoom,
+            tool_name(tool, fill_mode),
+            mouse_x,
+            mouse_y,
+            save_status
+        );
 
-        for (int i = 0; i < points_size; ++i)
-        {
-            Point *point = points[i];
+        // The canvas fills the window below the top bar and is cut off there.
+        // Only the cells inside it are visited, so the cost of a frame
+        // depends on the window size rather than the canvas size.
+        SDL_Rect area = canvas_area(ren);
+        SDL_RenderSetClipRect(ren, &area);
 
-            SDL_Rect rect = {
-                .x = point->x, .y = point->y, .w = CELL_SIZE, .h = CELL_SIZE
-            };
+        draw_grid(ren, &grid, &view, &canvas, &area);
+        draw_canvas(
+            ren, &canvas_texture, &view, &canvas, &brush_colors, &area
+        );
 
-            SDL_SetRenderDrawColor(
-                ren,
-                point->color.r,
-                point->color.g,
-                point->color.b,
-                point->color.a
+        if (canvas_contains(
+                &canvas, cursor_brush.grid_pos.row, cursor_brush.grid_pos.column
+            ))
+        {
+            SDL_Rect brush_rect = view_cell_rect(
+                &view, cursor_brush.grid_pos.row, cursor_brush.grid_pos.column
             );
-            SDL_RenderFillRect(ren, &rect);
-        }
-
-        SDL_Rect brush_rect = {
-            .x = cells
-                     .grid[cursor_brush.grid_pos.row]
-                          [cursor_brush.grid_pos.column]
-                     .x,
-            .y = cells
-                     .grid[cursor_brush.grid_pos.row]
-                          [cursor_brush.grid_pos.column]
-                     .y,
-            .w = CELL_SIZE,
-            .h = CELL_SIZE
-        };
 
-        SDL_SetRenderDrawColor(ren, 255, 0, 0, 255);
-        SDL_RenderFillRect(ren, &brush_rect);
+            SDL_SetRenderDrawColor(ren, 255, 0, 0, 255);
+            SDL_RenderFillRect(ren, &brush_rect);
+        }
+
+        draw_selection(ren, &view, &selection);
 
+        SDL_RenderSetClipRect(ren, NULL);
         SDL_RenderPresent(ren);
+
+        memcpy(shown_status, save_status, sizeof(shown_status));
+        damaged    = false;
+        last_frame = SDL_GetTicks();
+        frames_rendered++;
     }
 
+    printf(
+        "Frames: %i rendered, %i skipped", frames_rendered, frames_skipped
+    );
+    if (!options.render)
+        printf(", %i not drawn", frames_undrawn);
+    printf("\n");
+
+    if (options.replay != NULL)
+    {
+        double seconds = (double)(SDL_GetPerformanceCounter() - session_start) /
+                         SDL_GetPerformanceFrequency();
+        printf(
+            "Replayed %i events in %.3f s (%.0f events/s)\n",
+            replay.events,
+            seconds,
+            replay.events / seconds
+        );
+        input_replay_close(&replay);
+    }
+    if (options.record != NULL)
+        input_record_close(&recorder);
+
+    saver_stop(&saver);
+    grid_texture_free(&grid);
+    canvas_texture_free(&canvas_texture);
+    info_bar_free(&info);
+    history_free(&history);
+    clipboard_free(&clipboard);
+    canvas_free(&canvas);
     TTF_CloseFont(font);
     SDL_DestroyWindow(win);
     SDL_DestroyRenderer(ren);
@@ -0,0 +1,924 @@
+#include "png.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/libattopng.h"
+
+// Largest width or height accepted
+#define PNG_MAX_SIZE (1 << 20)
+
+#define PNG_INPUT_SIZE  16384
+#define PNG_WINDOW_SIZE 32768
+#define PNG_WINDOW_MASK (PNG_WINDOW_SIZE - 1)
+
+// Huffman codes up to PNG_FAST_BITS long are decoded with one table lookup,
+// longer ones a bit at a time
+#define PNG_FAST_BITS 9
+#define PNG_FAST_MASK ((1 << PNG_FAST_BITS) - 1)
+#define PNG_MAX_BITS  15
+
+typedef struct
+{
+    // Indexed by the next PNG_FAST_BITS input bits: code length << 9 |
+    // symbol, or 0 if the code is longer
+    uint16_t fast[1 << PNG_FAST_BITS];
+    // Number of codes of each length, and the symbols in code order
+    uint16_t count[PNG_MAX_BITS + 1];
+    uint16_t symbol[288];
+} PngHuffman;
+
+typedef enum
+{
+    // Next up is the header of a deflate block
+    PNG_BLOCK_HEADER,
+    PNG_BLOCK_STORED,
+    PNG_BLOCK_CODES,
+    // The last block ended
+    PNG_BLOCK_END,
+} PngBlock;
+
+struct PngStream
+{
+    FILE *file;
+    char file_name[256];
+    bool failed;
+
+    int color_type;
+    // Bytes per pixel, and per row without the filter byte
+    int channels;
+    size_t row_bytes;
+    uint8_t palette[256][4];
+    int palette_size;
+    // Color that is transparent in a gray or RGB image
+    bool has_key;
+    uint8_t key[3];
+
+    // Row being decoded, starting with its filter type, and the row before
+    // it with its filter type already stripped
+    uint8_t *row;
+    uint8_t *prior;
+
+    // Data of the IDAT chunks, read a buffer at a time
+    uint8_t input[PNG_INPUT_SIZE];
+    size_t input_pos;
+    size_t input_length;
+    uint32_t chunk_left;
+    uint32_t chunk_crc;
+    // A chunk other than IDAT followed, there is no more data
+    bool input_end;
+
+    // Input bits not consumed yet, lowest first. Past the end of the data
+    // zeros are shifted in, `overrun` of them; consuming any is an error.
+    uint64_t bits;
+    int bit_count;
+    int overrun;
+
+    PngBlock block;
+    bool last_block;
+    uint32_t stored_left;
+    // Match being copied out of the window
+    int copy_length;
+    int copy_distance;
+    PngHuffman literals;
+    PngHuffman distances;
+    uint8_t window[PNG_WINDOW_SIZE];
+    uint32_t window_pos;
+    // Bytes inflated so far, and their Adler-32
+    uint64_t total;
+    uint32_t adler;
+};
+
+static bool png_fail(PngStream *stream, const char *message)
+{
+    if (!stream->failed)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to read '%s': %s\n",
+            stream->file_name,
+            message
+        );
+    }
+    stream->failed = true;
+    return false;
+}
+
+static uint32_t png_u32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static bool png_read(PngStream *stream, uint8_t *data, size_t size)
+{
+    if (fread(data, 1, size, stream->file) != size)
+        return png_fail(stream, "unexpected end of file");
+    return true;
+}
+
+static bool png_chunk_header(
+    PngStream *stream, uint32_t *length, uint8_t type[4]
+)
+{
+    uint8_t header[8];
+    if (!png_read(stream, header, sizeof(header)))
+        return false;
+
+    *length = png_u32(header);
+    memcpy(type, header + 4, 4);
+    if (*length > 0x7fffffff)
+        return png_fail(stream, "bad chunk length");
+    return true;
+}
+
+// Reads the `length` bytes of a chunk into `data` and checks its CRC
+static bool png_chunk_data(
+    PngStream *stream,
+    const uint8_t type[4],
+    uint32_t length,
+    uint8_t *data,
+    size_t size
+)
+{
+    uint8_t crc[4];
+    if (length > size)
+        return png_fail(stream, "bad chunk length");
+    if (!png_read(stream, data, length) || !png_read(stream, crc, 4))
+        return false;
+
+    uint32_t check = libattopng_crc32(0, type, 4);
+    check          = libattopng_crc32(check, data, length);
+    if (png_u32(crc) != check)
+        return png_fail(stream, "bad chunk checksum");
+    return true;
+}
+
+// Refills the input buffer from the IDAT chunks, checking the CRC of each
+// one as it ends. Returns false once there is no more data.
+static bool png_fill_input(PngStream *stream)
+{
+    while (stream->chunk_left == 0)
+    {
+        if (stream->input_end || stream->failed)
+            return false;
+
+        uint8_t crc[4];
+        if (!png_read(stream, crc, 4))
+            return false;
+        if (png_u32(crc) != stream->chunk_crc)
+            return png_fail(stream, "bad chunk checksum");
+
+        uint8_t type[4];
+        uint32_t length;
+        if (!png_chunk_header(stream, &length, type))
+            return false;
+        if (memcmp(type, "IDAT", 4) != 0)
+        {
+            stream->input_end = true;
+            return false;
+        }
+        stream->chunk_left = length;
+        stream->chunk_crc  = libattopng_crc32(0, type, 4);
+    }
+
+    size_t size = stream->chunk_left < PNG_INPUT_SIZE ? stream->chunk_left
+                                                      : PNG_INPUT_SIZE;
+    if (!png_read(stream, stream->input, size))
+        return false;
+
+    stream->chunk_crc =
+        libattopng_crc32(stream->chunk_crc, stream->input, size);
+    stream->chunk_left -= size;
+    stream->input_pos    = 0;
+    stream->input_length = size;
+    return true;
+}
+
+static void png_refill(PngStream *stream)
+{
+    while (stream->bit_count <= 56)
+    {
+        uint64_t byte = 0;
+        if (stream->input_pos < stream->input_length || png_fill_input(stream))
+            byte = stream->input[stream->input_pos++];
+        else
+            stream->overrun += 8;
+
+        stream->bits |= byte << stream->bit_count;
+        stream->bit_count += 8;
+    }
+}
+
+static uint32_t png_bits(PngStream *stream, int count)
+{
+    if (stream->bit_count < count)
+        png_refill(stream);
+
+    uint32_t value = (uint32_t)stream->bits & ((1u << count) - 1);
+    stream->bits >>= count;
+    stream->bit_count -= count;
+    return value;
+}
+
+// Builds the canonical Huffman code with the code `lengths` of `count`
+// symbols. Returns false if the lengths are over-subscribed.
+static bool png_build(PngHuffman *huffman, const uint8_t *lengths, int count)
+{
+    memset(huffman, 0, sizeof(*huffman));
+    for (int i = 0; i < count; ++i)
+        huffman->count[lengths[i]]++;
+    huffman->count[0] = 0;
+
+    int left = 1;
+    for (int length = 1; length <= PNG_MAX_BITS; ++length)
+    {
+        left = (left << 1) - huffman->count[length];
+        if (left < 0)
+            return false;
+    }
+
+    // First index in `symbol` and first code of each length
+    int offsets[PNG_MAX_BITS + 1];
+    int codes[PNG_MAX_BITS + 1];
+    offsets[1] = 0;
+    codes[1]   = 0;
+    for (int length = 1; length < PNG_MAX_BITS; ++length)
+    {
+        offsets[length + 1] = offsets[length] + huffman->count[length];
+        codes[length + 1]   = (codes[length] + huffman->count[length]) << 1;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        int length = lengths[i];
+        if (length == 0)
+            continue;
+        huffman->symbol[offsets[length]++] = (uint16_t)i;
+
+        int code = codes[length]++;
+        if (length > PNG_FAST_BITS)
+            continue;
+
+        // Codes are sent starting from their top bit
+        int reversed = 0;
+        for (int bit = 0; bit < length; ++bit)
+            reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+        for (int k = reversed; k <= PNG_FAST_MASK; k += 1 << length)
+            huffman->fast[k] = (uint16_t)(length << 9 | i);
+    }
+
+    return true;
+}
+
+// Decodes one symbol, or returns -1 for a code that is not in `huffman`
+static int png_decode(PngStream *stream, const PngHuffman *huffman)
+{
+    if (stream->bit_count < PNG_MAX_BITS)
+        png_refill(stream);
+
+    int entry = huffman->fast[stream->bits & PNG_FAST_MASK];
+    if (entry != 0)
+    {
+        stream->bits >>= entry >> 9;
+        stream->bit_count -= entry >> 9;
+        return entry & 511;
+    }
+
+    int code  = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= PNG_MAX_BITS; ++length)
+    {
+        code |= (int)(stream->bits & 1);
+        stream->bits >>= 1;
+        stream->bit_count--;
+
+        int count = huffman->count[length];
+        if (code - count < first)
+            return huffman->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+static void png_fixed_codes(PngStream *stream)
+{
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    png_build(&stream->literals, lengths, 288);
+
+    memset(lengths, 5, 30);
+    png_build(&stream->distances, lengths, 30);
+}
+
+static bool png_dynamic_codes(PngStream *stream)
+{
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+
+    int literals  = (int)png_bits(stream, 5) + 257;
+    int distances = (int)png_bits(stream, 5) + 1;
+    int codes     = (int)png_bits(stream, 4) + 4;
+    if (literals > 286 || distances > 30)
+        return png_fail(stream, "bad code lengths");
+
+    uint8_t lengths[286 + 30] = {0};
+    for (int i = 0; i < codes; ++i)
+        lengths[order[i]] = (uint8_t)png_bits(stream, 3);
+
+    PngHuffman code_lengths;
+    if (!png_build(&code_lengths, lengths, 19))
+        return png_fail(stream, "bad code lengths");
+
+    int i = 0;
+    while (i < literals + distances)
+    {
+        int symbol = png_decode(stream, &code_lengths);
+        if (symbol < 0)
+            return png_fail(stream, "bad code lengths");
+
+        if (symbol < 16)
+        {
+            lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t length = 0;
+        int repeat;
+        if (symbol == 16)
+        {
+            if (i == 0)
+                return png_fail(stream, "bad code lengths");
+            length = lengths[i - 1];
+            repeat = 3 + (int)png_bits(stream, 2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + (int)png_bits(stream, 3);
+        }
+        else
+        {
+            repeat = 11 + (int)png_bits(stream, 7);
+        }
+
+        if (i + repeat > literals + distances)
+            return png_fail(stream, "bad code lengths");
+        memset(lengths + i, length, repeat);
+        i += repeat;
+    }
+
+    if (lengths[256] == 0 ||
+        !png_build(&stream->literals, lengths, literals) ||
+        !png_build(&stream->distances, lengths + literals, distances))
+    {
+        return png_fail(stream, "bad code lengths");
+    }
+
+    return true;
+}
+
+static void png_block_header(PngStream *stream)
+{
+    stream->last_block = png_bits(stream, 1) != 0;
+
+    switch (png_bits(stream, 2))
+    {
+        case 0:
+        {
+            // Stored block: LEN and its complement at the next byte boundary
+            png_bits(stream, stream->bit_count & 7);
+            uint32_t length     = png_bits(stream, 16);
+            uint32_t complement = png_bits(stream, 16);
+            if (length != (~complement & 0xffff))
+            {
+                png_fail(stream, "bad stored block");
+                return;
+            }
+            stream->stored_left = length;
+            stream->block       = PNG_BLOCK_STORED;
+            break;
+        }
+        case 1:
+            png_fixed_codes(stream);
+            stream->block = PNG_BLOCK_CODES;
+            break;
+        case 2:
+            if (png_dynamic_codes(stream))
+                stream->block = PNG_BLOCK_CODES;
+            break;
+        default:
+            png_fail(stream, "bad block type");
+            break;
+    }
+}
+
+// Copies up to `size` bytes of the current stored block to `out`. Returns
+// the number of bytes copied.
+static size_t png_stored(PngStream *stream, uint8_t *out, size_t size)
+{
+    if (size > stream->stored_left)
+        size = stream->stored_left;
+
+    size_t done = 0;
+    while (done < size && stream->bit_count >= 8)
+        out[done++] = (uint8_t)png_bits(stream, 8);
+
+    // Once the bit buffer is drained, bytes come straight from the input
+    while (done < size && !stream->failed)
+    {
+        if (stream->input_pos == stream->input_length &&
+            !png_fill_input(stream))
+        {
+            png_fail(stream, "image data ends early");
+            break;
+        }
+
+        size_t count = stream->input_length - stream->input_pos;
+        if (count > size - done)
+            count = size - done;
+        memcpy(out + done, stream->input + stream->input_pos, count);
+        stream->input_pos += count;
+        done += count;
+    }
+
+    for (size_t i = 0; i < done; ++i)
+        stream->window[stream->window_pos++ & PNG_WINDOW_MASK] = out[i];
+    stream->stored_left -= (uint32_t)done;
+    return done;
+}
+
+// Inflates up to `size` bytes into `out`. Returns the number of bytes
+// written, which is less than `size` only at the end of the stream or on
+// error.
+static size_t png_inflate(PngStream *stream, uint8_t *out, size_t size)
+{
+    static const uint16_t length_base[29] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8_t length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const uint16_t distance_base[30] = {
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577
+    };
+    static const uint8_t distance_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    uint8_t *window = stream->window;
+    size_t done     = 0;
+    while (done < size && !stream->failed)
+    {
+        if (stream->copy_length > 0)
+        {
+            uint32_t from = stream->window_pos - stream->copy_distance;
+            while (stream->copy_length > 0 && done < size)
+            {
+                uint8_t byte = window[from++ & PNG_WINDOW_MASK];
+                window[stream->window_pos++ & PNG_WINDOW_MASK] = byte;
+                out[done++]                                    = byte;
+                stream->copy_length--;
+            }
+            continue;
+        }
+
+        if (stream->block == PNG_BLOCK_END)
+            break;
+
+        if (stream->block == PNG_BLOCK_HEADER)
+        {
+            png_block_header(stream);
+            continue;
+        }
+
+        if (stream->block == PNG_BLOCK_STORED)
+        {
+            if (stream->stored_left == 0)
+            {
+                stream->block = stream->last_block ? PNG_BLOCK_END
+                                                   : PNG_BLOCK_HEADER;
+                continue;
+            }
+            done += png_stored(stream, out + done, size - done);
+            continue;
+        }
+
+        int symbol = png_decode(stream, &stream->literals);
+        if (symbol < 256)
+        {
+            if (symbol < 0)
+            {
+                png_fail(stream, "bad literal code");
+                break;
+            }
+            window[stream->window_pos++ & PNG_WINDOW_MASK] = (uint8_t)symbol;
+            out[done++]                                    = (uint8_t)symbol;
+        }
+        else if (symbol == 256)
+        {
+            stream->block = stream->last_block ? PNG_BLOCK_END
+                                               : PNG_BLOCK_HEADER;
+        }
+        else
+        {
+            symbol -= 257;
+            if (symbol >= 29)
+            {
+                png_fail(stream, "bad length code");
+                break;
+            }
+            int length = length_base[symbol] +
+                         (int)png_bits(stream, length_extra[symbol]);
+
+            symbol = png_decode(stream, &stream->distances);
+            if (symbol < 0 || symbol >= 30)
+            {
+                png_fail(stream, "bad distance code");
+                break;
+            }
+            int distance = distance_base[symbol] +
+                           (int)png_bits(stream, distance_extra[symbol]);
+            if ((uint64_t)distance > stream->total + done)
+            {
+                png_fail(stream, "distance too far back");
+                break;
+            }
+            stream->copy_length   = length;
+            stream->copy_distance = distance;
+        }
+
+        if (stream->bit_count < stream->overrun)
+            png_fail(stream, "image data ends early");
+    }
+
+    if (stream->bit_count < stream->overrun)
+        png_fail(stream, "image data ends early");
+    stream->total += done;
+    return done;
+}
+
+// Checks that the deflate stream ends after the last row, with the right
+// Adler-32, and that the IDAT chunks end with it
+static bool png_end(PngStream *stream)
+{
+    uint8_t extra;
+    if (png_inflate(stream, &extra, 1) != 0)
+        return png_fail(stream, "too much image data");
+    if (stream->failed)
+        return false;
+
+    png_bits(stream, stream->bit_count & 7);
+    uint32_t adler = 0;
+    for (int i = 0; i < 4; ++i)
+        adler = adler << 8 | png_bits(stream, 8);
+    if (stream->bit_count < stream->overrun)
+        return png_fail(stream, "image data ends early");
+    if (adler != stream->adler)
+        return png_fail(stream, "bad image data checksum");
+
+    // Whatever is left of the last IDAT chunk still has its CRC checked
+    stream->input_pos = stream->input_length;
+    while (png_fill_input(stream))
+        stream->input_pos = stream->input_length;
+
+    return !stream->failed;
+}
+
+static uint8_t png_paeth(int a, int b, int c)
+{
+    int p  = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return (uint8_t)a;
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+// Undoes the filter of the current row, in place
+static bool png_unfilter(PngStream *stream)
+{
+    uint8_t *row       = stream->row + 1;
+    const uint8_t *up  = stream->prior + 1;
+    size_t size        = stream->row_bytes;
+    size_t bpp         = (size_t)stream->channels;
+
+    switch (stream->row[0])
+    {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < size; ++i)
+                row[i] += row[i - bpp];
+            break;
+        case 2:
+            for (size_t i = 0; i < size; ++i)
+                row[i] += up[i];
+            break;
+        case 3:
+            for (size_t i = 0; i < bpp; ++i)
+                row[i] += up[i] >> 1;
+            for (size_t i = bpp; i < size; ++i)
+                row[i] += (row[i - bpp] + up[i]) >> 1;
+            break;
+        case 4:
+            for (size_t i = 0; i < bpp; ++i)
+                row[i] += up[i];
+            for (size_t i = bpp; i < size; ++i)
+                row[i] += png_paeth(row[i - bpp], up[i], up[i - bpp]);
+            break;
+        default:
+            return png_fail(stream, "bad filter type");
+    }
+
+    return true;
+}
+
+// Expands the unfiltered current row to RGBA
+static bool png_convert(PngStream *stream, int width, uint8_t *rgba)
+{
+    const uint8_t *row = stream->row + 1;
+    const uint8_t *key = stream->key;
+
+    switch (stream->color_type)
+    {
+        case 0:
+            for (int x = 0; x < width; ++x, rgba += 4)
+            {
+                uint8_t gray = row[x];
+                rgba[0] = rgba[1] = rgba[2] = gray;
+                rgba[3] = stream->has_key && gray == key[0] ? 0 : 255;
+            }
+            break;
+        case 2:
+            for (int x = 0; x < width; ++x, rgba += 4, row += 3)
+            {
+                memcpy(rgba, row, 3);
+                rgba[3] = stream->has_key && memcmp(row, key, 3) == 0 ? 0 : 255;
+            }
+            break;
+        case 3:
+            for (int x = 0; x < width; ++x, rgba += 4)
+            {
+                if (row[x] >= stream->palette_size)
+                    return png_fail(stream, "palette index out of range");
+                memcpy(rgba, stream->palette[row[x]], 4);
+            }
+            break;
+        case 4:
+            for (int x = 0; x < width; ++x, rgba += 4, row += 2)
+            {
+                rgba[0] = rgba[1] = rgba[2] = row[0];
+                rgba[3]                     = row[1];
+            }
+            break;
+        case 6:
+            memcpy(rgba, row, (size_t)width * 4);
+            break;
+    }
+
+    return true;
+}
+
+static bool png_header(
+    PngStream *stream, const uint8_t *data, PngReader *reader
+)
+{
+    uint32_t width  = png_u32(data);
+    uint32_t height = png_u32(data + 4);
+    if (width < 1 || width > PNG_MAX_SIZE || height < 1 ||
+        height > PNG_MAX_SIZE)
+    {
+        return png_fail(stream, "unsupported image size");
+    }
+    if (data[8] != 8)
+        return png_fail(stream, "only 8 bits per channel are supported");
+    if (data[10] != 0 || data[11] != 0)
+        return png_fail(stream, "unknown compression or filter method");
+    if (data[12] != 0)
+        return png_fail(stream, "interlaced images are not supported");
+
+    static const int channels[7] = {1, 0, 3, 1, 2, 0, 4};
+    stream->color_type = data[9];
+    if (stream->color_type > 6 || channels[stream->color_type] == 0)
+        return png_fail(stream, "unknown color type");
+
+    stream->channels  = channels[stream->color_type];
+    stream->row_bytes = (size_t)width * stream->channels;
+    reader->width     = (int)width;
+    reader->height    = (int)height;
+    return true;
+}
+
+static bool png_transparency(
+    PngStream *stream, const uint8_t *data, uint32_t length
+)
+{
+    switch (stream->color_type)
+    {
+        case 0:
+        case 2:
+        {
+            // 16-bit samples, a key above 255 matches no 8-bit pixel
+            uint32_t samples = stream->color_type == 0 ? 1 : 3;
+            if (length != samples * 2)
+                return png_fail(stream, "bad transparency");
+            stream->has_key = true;
+            for (uint32_t i = 0; i < samples; ++i)
+            {
+                stream->has_key = stream->has_key && data[i * 2] == 0;
+                stream->key[i]  = data[i * 2 + 1];
+            }
+            break;
+        }
+        case 3:
+            if (length > (uint32_t)stream->palette_size)
+                return png_fail(stream, "bad transparency");
+            for (uint32_t i = 0; i < length; ++i)
+                stream->palette[i][3] = data[i];
+            break;
+    }
+
+    return true;
+}
+
+// Reads the chunks up to the first IDAT, and the zlib header at its start
+static bool png_read_header(PngReader *reader)
+{
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+    PngStream *stream = reader->stream;
+    uint8_t data[768];
+    if (!png_read(stream, data, 8) || memcmp(data, signature, 8) != 0)
+        return png_fail(stream, "not a PNG image");
+
+    bool has_header = false;
+    for (;;)
+    {
+        uint8_t type[4];
+        uint32_t length;
+        if (!png_chunk_header(stream, &length, type))
+            return false;
+
+        if (memcmp(type, "IHDR", 4) == 0)
+        {
+            if (has_header || length != 13 ||
+                !png_chunk_data(stream, type, length, data, sizeof(data)) ||
+                !png_header(stream, data, reader))
+            {
+                return png_fail(stream, "bad header");
+            }
+            has_header = true;
+        }
+        else if (!has_header)
+        {
+            return png_fail(stream, "missing header");
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            if (length % 3 != 0 ||
+                !png_chunk_data(stream, type, length, data, sizeof(data)))
+            {
+                return png_fail(stream, "bad palette");
+            }
+            stream->palette_size = (int)length / 3;
+            for (int i = 0; i < stream->palette_size; ++i)
+            {
+                memcpy(stream->palette[i], &data[i * 3], 3);
+                stream->palette[i][3] = 255;
+            }
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            if (!png_chunk_data(stream, type, length, data, sizeof(data)) ||
+                !png_transparency(stream, data, length))
+            {
+                return false;
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            stream->chunk_left = length;
+            stream->chunk_crc  = libattopng_crc32(0, type, 4);
+            break;
+        }
+        else if ((type[0] & 0x20) == 0)
+        {
+            // Chunks with an upper case first letter cannot be ignored
+            return png_fail(stream, "unsupported chunk");
+        }
+        else if (fseek(stream->file, (long)length + 4, SEEK_CUR) != 0)
+        {
+            return png_fail(stream, "unexpected end of file");
+        }
+    }
+
+    if (stream->color_type == 3 && stream->palette_size == 0)
+        return png_fail(stream, "missing palette");
+
+    uint32_t method = png_bits(stream, 8);
+    uint32_t flags  = png_bits(stream, 8);
+    if ((method & 0x0f) != 8 || (method >> 4) > 7 ||
+        (method << 8 | flags) % 31 != 0 || (flags & 0x20) != 0)
+    {
+        return png_fail(stream, "bad zlib header");
+    }
+
+    stream->row   = malloc(stream->row_bytes + 1);
+    stream->prior = calloc(1, stream->row_bytes + 1);
+    if (stream->row == NULL || stream->prior == NULL)
+        return png_fail(stream, "out of memory");
+
+    return !stream->failed;
+}
+
+bool png_open(PngReader *reader, const char *file_name)
+{
+    *reader = (PngReader){.stream = calloc(1, sizeof(PngStream))};
+    if (reader->stream == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to allocate PNG decoder\n");
+        return false;
+    }
+
+    PngStream *stream = reader->stream;
+    snprintf(stream->file_name, sizeof(stream->file_name), "%s", file_name);
+    stream->block = PNG_BLOCK_HEADER;
+    stream->adler = 1;
+
+    stream->file = fopen(file_name, "rb");
+    if (stream->file == NULL)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to open '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        png_close(reader);
+        return false;
+    }
+
+    if (!png_read_header(reader))
+    {
+        png_close(reader);
+        return false;
+    }
+
+    return true;
+}
+
+bool png_read_row(PngReader *reader, uint8_t *rgba)
+{
+    PngStream *stream = reader->stream;
+    if (stream->failed || reader->row >= reader->height)
+        return false;
+
+    size_t size = stream->row_bytes + 1;
+    if (png_inflate(stream, stream->row, size) != size)
+        return png_fail(stream, "image data ends early");
+    stream->adler = libattopng_adler32(stream->adler, stream->row, size);
+
+    if (!png_unfilter(stream) || !png_convert(stream, reader->width, rgba))
+        return false;
+
+    // The row just decoded is the prior row of the next one
+    uint8_t *row  = stream->row;
+    stream->row   = stream->prior;
+    stream->prior = row;
+
+    reader->row++;
+    if (reader->row == reader->height)
+        return png_end(stream);
+
+    return true;
+}
+
+void png_close(PngReader *reader)
+{
+    PngStream *stream = reader->stream;
+    if (stream == NULL)
+        return;
+
+    if (stream->file != NULL)
+        fclose(stream->file);
+    free(stream->row);
+    free(stream->prior);
+    free(stream);
+    reader->stream = NULL;
+}
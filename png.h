@@ -0,0 +1,34 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decoder state, private to png.c
+typedef struct PngStream PngStream;
+
+// PNG file being decoded a row at a time. Only the compressed input buffer,
+// the 32 KiB inflate window and two rows are held in memory, whatever the
+// size of the image. Gray, RGB, palette, gray with alpha and RGBA images at
+// 8 bits per channel are supported, without interlacing.
+typedef struct
+{
+    int width;
+    int height;
+    // Rows handed out so far
+    int row;
+    PngStream *stream;
+} PngReader;
+
+// Opens `file_name` and reads the header chunks. Returns false, with an
+// error printed, if the file cannot be read or is not a supported PNG.
+bool png_open(PngReader *reader, const char *file_name);
+
+// Decodes the next row into `rgba`, 4 bytes per pixel. Returns false once
+// all rows were read or if the image data is damaged. The checksum of the
+// image data is verified when the last row is read.
+bool png_read_row(PngReader *reader, uint8_t *rgba);
+
+void png_close(PngReader *reader);
+
+#endif // PNG_H
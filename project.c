@@ -0,0 +1,358 @@
+#include "project.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PROJECT_MAGIC      "PXARTPRJ"
+#define PROJECT_VERSION    1
+#define PROJECT_BYTE_ORDER 0x01020304u
+
+// Stored tiles start on a page boundary, so each one lies in whole pages of
+// the mapping
+#define PROJECT_ALIGN 4096
+
+#define PROJECT_TILE_CELLS (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+// Set in ProjectEntry.block for a tile whose cells are all the value in the
+// low 8 bits
+#define PROJECT_SOLID 0x80000000u
+
+typedef struct
+{
+    char magic[8];
+    // Written in the byte order of the machine, files from a machine of the
+    // other order are rejected
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t rows;
+    uint32_t columns;
+    uint32_t cell_size;
+    uint32_t color_count;
+    // Number of tiles with their cells stored after the index
+    uint32_t stored_tiles;
+    uint32_t reserved;
+    // Byte offsets of the tile index and of the first stored tile
+    uint64_t index_offset;
+    uint64_t tiles_offset;
+    uint8_t colors[256][4];
+} ProjectHeader;
+
+// Index entry of one tile, in the order of Canvas.data->tiles
+typedef struct
+{
+    // 0 for an empty tile, PROJECT_SOLID with the value of a single color
+    // tile, or else 1 + the number of the stored tile
+    uint32_t block;
+    uint32_t painted;
+} ProjectEntry;
+
+static size_t project_align(size_t offset, size_t align)
+{
+    return (offset + align - 1) / align * align;
+}
+
+// Entry for `tile`, which is stored unless it is empty or a single color
+static ProjectEntry project_entry(const CanvasTile *tile, uint32_t *stored)
+{
+    if (tile == NULL)
+        return (ProjectEntry){.block = 0, .painted = 0};
+
+    // Only a fully painted tile can be one color, and then every cell equals
+    // the one before it
+    if (tile->painted == PROJECT_TILE_CELLS &&
+        memcmp(tile->cells, tile->cells + 1, PROJECT_TILE_CELLS - 1) == 0)
+    {
+        return (ProjectEntry){
+            .block   = PROJECT_SOLID | tile->cells[0],
+            .painted = PROJECT_TILE_CELLS
+        };
+    }
+
+    return (ProjectEntry){.block = ++*stored, .painted = tile->painted};
+}
+
+bool project_save(
+    const char *file_name, const Canvas *canvas, const ProjectInfo *info
+)
+{
+    size_t count = (size_t)canvas->tile_rows * canvas->tile_columns;
+    ProjectEntry *index = malloc(count * sizeof(ProjectEntry));
+    if (index == NULL)
+    {
+        fprintf(stderr, "ERROR: Failed to allocate project index\n");
+        return false;
+    }
+
+    uint32_t stored = 0;
+    for (size_t i = 0; i < count; ++i)
+        index[i] = project_entry(canvas->data->tiles[i], &stored);
+
+    size_t index_offset = project_align(sizeof(ProjectHeader), 8);
+    size_t tiles_offset = project_align(
+        index_offset + count * sizeof(ProjectEntry), PROJECT_ALIGN
+    );
+    size_t size = tiles_offset + (size_t)stored * PROJECT_TILE_CELLS;
+
+    // The old file stays intact until the new one is complete
+    char temp_name[1024];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+
+    int fd = open(temp_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to create '%s': %s\n",
+            temp_name,
+            strerror(errno)
+        );
+        free(index);
+        return false;
+    }
+
+    uint8_t *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to map '%s': %s\n",
+            temp_name,
+            strerror(errno)
+        );
+        close(fd);
+        unlink(temp_name);
+        free(index);
+        return false;
+    }
+
+    ProjectHeader header = {
+        .byte_order   = PROJECT_BYTE_ORDER,
+        .version      = PROJECT_VERSION,
+        .rows         = (uint32_t)canvas->rows,
+        .columns      = (uint32_t)canvas->columns,
+        .cell_size    = (uint32_t)info->cell_size,
+        .color_count  = (uint32_t)info->color_count,
+        .stored_tiles = stored,
+        .index_offset = index_offset,
+        .tiles_offset = tiles_offset
+    };
+    memcpy(header.magic, PROJECT_MAGIC, sizeof(header.magic));
+    memcpy(header.colors, info->colors, info->color_count * 4);
+    memcpy(map, &header, sizeof(header));
+    memcpy(map + index_offset, index, count * sizeof(ProjectEntry));
+
+    uint8_t *block = map + tiles_offset;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (index[i].block == 0 || (index[i].block & PROJECT_SOLID) != 0)
+            continue;
+        memcpy(block, canvas->data->tiles[i]->cells, PROJECT_TILE_CELLS);
+        block += PROJECT_TILE_CELLS;
+    }
+    free(index);
+
+    bool ok = munmap(map, size) == 0;
+    ok      = close(fd) == 0 && ok;
+    if (!ok || rename(temp_name, file_name) != 0)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to save project to '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        unlink(temp_name);
+        return false;
+    }
+
+    return true;
+}
+
+// Checks that the header describes a project this build can read, and that
+// everything it points to lies within the `size` bytes of the file
+static bool project_check(const ProjectHeader *header, size_t size)
+{
+    if (memcmp(header->magic, PROJECT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->byte_order != PROJECT_BYTE_ORDER ||
+        header->version != PROJECT_VERSION)
+    {
+        return false;
+    }
+
+    if (header->rows < 1 || header->rows > PROJECT_MAX_SIZE ||
+        header->columns < 1 || header->columns > PROJECT_MAX_SIZE ||
+        header->cell_size < 1 || header->color_count > 255)
+    {
+        return false;
+    }
+
+    size_t tiles =
+        (size_t)((header->rows + CANVAS_TILE_SIZE - 1) >> CANVAS_TILE_BITS) *
+        ((header->columns + CANVAS_TILE_SIZE - 1) >> CANVAS_TILE_BITS);
+    return header->index_offset % sizeof(uint32_t) == 0 &&
+           header->index_offset <= size &&
+           tiles * sizeof(ProjectEntry) <= size - header->index_offset &&
+           header->tiles_offset <= size &&
+           (size_t)header->stored_tiles * PROJECT_TILE_CELLS <=
+               size - header->tiles_offset;
+}
+
+// Fills the tiles of `canvas` from the index and stored tiles at `map`
+// Number of painted cells in a stored tile whose first `height` rows and
+// `width` columns lie on the canvas, or -1 if a cell refers to a color the
+// file does not have or is painted off the canvas
+static int project_tile_painted(
+    const uint8_t *cells, int height, int width, int color_count
+)
+{
+    int painted = 0;
+    for (int j = 0; j < PROJECT_TILE_CELLS; ++j)
+    {
+        if (cells[j] == CANVAS_EMPTY)
+            continue;
+
+        int row    = j >> CANVAS_TILE_BITS;
+        int column = j & CANVAS_TILE_MASK;
+        if (cells[j] > color_count || row >= height || column >= width)
+            return -1;
+        painted++;
+    }
+
+    return painted;
+}
+
+static bool project_read_tiles(
+    Canvas *canvas, const ProjectHeader *header, const uint8_t *map
+)
+{
+    const ProjectEntry *index =
+        (const ProjectEntry *)(map + header->index_offset);
+    const uint8_t *blocks = map + header->tiles_offset;
+
+    for (int i = 0; i < canvas->tile_rows * canvas->tile_columns; ++i)
+    {
+        ProjectEntry entry = index[i];
+        if (entry.block == 0)
+            continue;
+
+        // Tiles on the last row and column may reach past the canvas
+        int tile_row    = i / canvas->tile_columns;
+        int tile_column = i % canvas->tile_columns;
+        int height      = canvas->rows - tile_row * CANVAS_TILE_SIZE;
+        int width       = canvas->columns - tile_column * CANVAS_TILE_SIZE;
+        height          = height < CANVAS_TILE_SIZE ? height : CANVAS_TILE_SIZE;
+        width           = width < CANVAS_TILE_SIZE ? width : CANVAS_TILE_SIZE;
+
+        // Cells may only refer to colors the file has, and the painted count
+        // must be right, since a tile is freed once it drops to 0
+        bool solid           = (entry.block & PROJECT_SOLID) != 0;
+        const uint8_t *cells = NULL;
+        bool valid;
+        if (solid)
+        {
+            // A single color fills the whole tile, which must be on the canvas
+            uint8_t value = entry.block & 0xff;
+            valid = value != CANVAS_EMPTY && value <= header->color_count &&
+                    entry.painted == PROJECT_TILE_CELLS &&
+                    height == CANVAS_TILE_SIZE && width == CANVAS_TILE_SIZE;
+        }
+        else
+        {
+            valid = entry.block <= header->stored_tiles && entry.painted >= 1;
+            if (valid)
+            {
+                cells = &blocks[(size_t)(entry.block - 1) * PROJECT_TILE_CELLS];
+                valid = project_tile_painted(
+                            cells, height, width, (int)header->color_count
+                        ) == (int)entry.painted;
+            }
+        }
+        if (!valid)
+            return false;
+
+        CanvasTile *tile = canvas_write_tile(canvas, i);
+        if (tile == NULL)
+            return false;
+
+        if (solid)
+            memset(tile->cells, entry.block & 0xff, PROJECT_TILE_CELLS);
+        else
+            memcpy(tile->cells, cells, PROJECT_TILE_CELLS);
+        tile->painted = (int)entry.painted;
+        canvas->painted += (int)entry.painted;
+    }
+
+    return true;
+}
+
+bool project_load(const char *file_name, Canvas *canvas, ProjectInfo *info)
+{
+    int fd = open(file_name, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to open '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(ProjectHeader))
+    {
+        fprintf(stderr, "ERROR: '%s' is not a project file\n", file_name);
+        close(fd);
+        return false;
+    }
+
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(
+            stderr,
+            "ERROR: Failed to map '%s': %s\n",
+            file_name,
+            strerror(errno)
+        );
+        return false;
+    }
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    ProjectHeader header;
+    memcpy(&header, map, sizeof(header));
+    bool ok = project_check(&header, size);
+    if (ok)
+    {
+        ok = canvas_init(canvas, (int)header.rows, (int)header.columns) &&
+             project_read_tiles(canvas, &header, map);
+        if (!ok)
+            canvas_free(canvas);
+    }
+    munmap(map, size);
+
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: Failed to load project '%s'\n", file_name);
+        return false;
+    }
+
+    info->cell_size   = (int)header.cell_size;
+    info->color_count = (int)header.color_count;
+    memcpy(info->colors, header.colors, header.color_count * 4);
+
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canvas.h"
+
+#define PROJECT_EXTENSION ".pxart"
+
+// Largest number of rows or columns a project file may have. Keeps the
+// painted cell count of a loaded canvas within an int.
+#define PROJECT_MAX_SIZE 32768
+
+// Everything a project file holds besides the cells
+typedef struct
+{
+    int cell_size;
+    // RGBA of each brush color, cell value `n` is painted with color `n - 1`
+    uint8_t colors[255][4];
+    int color_count;
+} ProjectInfo;
+
+// A project file is a fixed header with the sizes and colors, then one entry
+// per canvas tile, then the cells of the stored tiles, page aligned and in
+// the same layout as CanvasTile.cells. Empty tiles take no room, and tiles
+// painted in a single color are kept in their entry alone. Loading maps the
+// file and copies whole tiles out of it, with no per-cell decoding.
+
+// Writes `canvas` and `info` to `file_name`, through a temporary file that
+// replaces it only once complete. Returns false on error.
+bool project_save(
+    const char *file_name, const Canvas *canvas, const ProjectInfo *info
+);
+
+// Initializes `canvas` with the cells of the project in `file_name` and
+// fills in `info`. Returns false, leaving `canvas` uninitialized, if the
+// file cannot be read or is not a valid project.
+bool project_load(const char *file_name, Canvas *canvas, ProjectInfo *info);
+
+#endif // PROJECT_H
@@ -0,0 +1,133 @@
+#include "selection.h"
+
+#include <stdlib.h>
+
+CellRange selection_between(int from_row, int from_col, int to_row, int to_col)
+{
+    return (CellRange){
+        .row     = from_row < to_row ? from_row : to_row,
+        .column  = from_col < to_col ? from_col : to_col,
+        .rows    = abs(to_row - from_row) + 1,
+        .columns = abs(to_col - from_col) + 1
+    };
+}
+
+bool selection_clip(const Canvas *canvas, CellRange *range)
+{
+    int top    = range->row > 0 ? range->row : 0;
+    int left   = range->column > 0 ? range->column : 0;
+    int bottom = range->row + range->rows;
+    int right  = range->column + range->columns;
+    if (bottom > canvas->rows)
+        bottom = canvas->rows;
+    if (right > canvas->columns)
+        right = canvas->columns;
+
+    range->row     = top;
+    range->column  = left;
+    range->rows    = bottom - top;
+    range->columns = right - left;
+
+    return range->rows > 0 && range->columns > 0;
+}
+
+bool selection_copy(
+    const Canvas *canvas, CellRange range, Clipboard *clipboard
+)
+{
+    uint8_t *cells = malloc((size_t)range.rows * range.columns);
+    if (cells == NULL)
+        return false;
+
+    for (int row = 0; row < range.rows; ++row)
+    {
+        canvas_read_row(
+            canvas,
+            range.row + row,
+            range.column,
+            range.columns,
+            &cells[(size_t)row * range.columns]
+        );
+    }
+
+    clipboard_free(clipboard);
+    clipboard->cells   = cells;
+    clipboard->rows    = range.rows;
+    clipboard->columns = range.columns;
+
+    return true;
+}
+
+void clipboard_free(Clipboard *clipboard)
+{
+    free(clipboard->cells);
+    clipboard->cells   = NULL;
+    clipboard->rows    = 0;
+    clipboard->columns = 0;
+}
+
+void selection_paste(
+    Canvas *canvas,
+    History *history,
+    const Clipboard *clipboard,
+    int row,
+    int column
+)
+{
+    CellRange range = {
+        .row     = row,
+        .column  = column,
+        .rows    = clipboard->rows,
+        .columns = clipboard->columns
+    };
+    if (clipboard->cells == NULL || !selection_clip(canvas, &range))
+        return;
+
+    // Offset of the first pasted cell inside the clipboard
+    int skip_rows    = range.row - row;
+    int skip_columns = range.column - column;
+    for (int i = 0; i < range.rows; ++i)
+    {
+        const uint8_t *cells =
+            &clipboard->cells
+                 [(size_t)(skip_rows + i) * clipboard->columns + skip_columns];
+        history_set_cells(
+            history, canvas, range.row + i, range.column, range.columns, cells
+        );
+    }
+}
+
+void selection_fill(
+    Canvas *canvas, History *history, CellRange range, uint8_t value
+)
+{
+    if (!selection_clip(canvas, &range))
+        return;
+
+    for (int row = range.row; row < range.row + range.rows; ++row)
+    {
+        history_set_run(
+            history, canvas, row, range.column, range.columns, value
+        );
+    }
+}
+
+bool selection_move(
+    Canvas *canvas, History *history, CellRange range, int rows, int columns
+)
+{
+    Clipboard block = {.cells = NULL};
+    if (!selection_clip(canvas, &range) ||
+        !selection_copy(canvas, range, &block))
+    {
+        return false;
+    }
+
+    selection_fill(canvas, history, range, CANVAS_EMPTY);
+    selection_paste(
+        canvas, history, &block, range.row + rows, range.column + columns
+    );
+    clipboard_free(&block);
+
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canvas.h"
+#include "history.h"
+
+// Block of cells copied out of a canvas, row-major
+typedef struct
+{
+    uint8_t *cells;
+    int rows;
+    int columns;
+} Clipboard;
+
+// Rectangle with the cells `from` and `to` as opposite corners, in either
+// order
+CellRange selection_between(int from_row, int from_col, int to_row, int to_col);
+
+// Cuts `range` down to the cells inside `canvas`. Returns false if none are.
+bool selection_clip(const Canvas *canvas, CellRange *range);
+
+// Replaces the contents of `clipboard` with the cells of `range`, which must
+// be inside the canvas. Returns false if out of memory.
+bool selection_copy(
+    const Canvas *canvas, CellRange range, Clipboard *clipboard
+);
+
+void clipboard_free(Clipboard *clipboard);
+
+// The operations below change whole rows at a time and record them in the
+// open history entry.
+
+// Writes `clipboard` with its top left corner at `row`, `column`, leaving out
+// whatever falls outside the canvas. Empty cells are pasted as well, so the
+// block replaces what was there.
+void selection_paste(
+    Canvas *canvas,
+    History *history,
+    const Clipboard *clipboard,
+    int row,
+    int column
+);
+
+// Sets every cell of `range` to `value`, CANVAS_EMPTY to delete them
+void selection_fill(
+    Canvas *canvas, History *history, CellRange range, uint8_t value
+);
+
+// Moves the cells of `range` by `rows` and `columns`, leaving empty cells
+// behind. The block goes through a buffer, so the source and destination
+// may overlap. Returns false if there was nothing to move or no memory for
+// the buffer.
+bool selection_move(
+    Canvas *canvas, History *history, CellRange range, int rows, int columns
+);
+
+#endif // SELECTION_H
@@ -0,0 +1,127 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "canvas.h"
+
+// Cell sizes are fixed point with VIEW_SCALE_BITS fraction bits, so a view
+// can be zoomed to any fraction of a pixel per cell
+#define VIEW_SCALE_BITS 8
+#define VIEW_SCALE_ONE  (1 << VIEW_SCALE_BITS)
+
+// Maps canvas cells to pixels and back. Everything that places cells on the
+// screen or in an exported image goes through a View, so they all agree on
+// where a cell is.
+typedef struct
+{
+    // Position of the top left corner of cell (0, 0)
+    int x;
+    int y;
+    // Width and height of a cell in 1/VIEW_SCALE_ONE pixels
+    int scale;
+} View;
+
+// View with `cell_size` whole pixels per cell
+static inline View view_at(int x, int y, int cell_size)
+{
+    return (View){.x = x, .y = y, .scale = cell_size * VIEW_SCALE_ONE};
+}
+
+// Rounds towards negative infinity, so positions left of or above cell 0
+// map to negative cells instead of cell 0
+static inline int64_t view_floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+// Offset in pixels of the edge before cell `cell`. Cells of a fractional
+// size start on the pixel their edge falls in, so neighbouring cells never
+// overlap or leave gaps.
+static inline int view_edge(const View *view, int cell)
+{
+    return (int)view_floor_div((int64_t)cell * view->scale, VIEW_SCALE_ONE);
+}
+
+// Whole pixels per cell, or 0 if the scale is fractional
+static inline int view_pixel_size(const View *view)
+{
+    return view->scale % VIEW_SCALE_ONE == 0 ? view->scale / VIEW_SCALE_ONE
+                                             : 0;
+}
+
+static inline void view_screen_to_cell(
+    const View *view, int x, int y, int *row, int *column
+)
+{
+    // Pixel `p` belongs to the last cell whose edge is at or before it
+    *row = (int)view_floor_div(
+        (int64_t)(y - view->y + 1) * VIEW_SCALE_ONE - 1, view->scale
+    );
+    *column = (int)view_floor_div(
+        (int64_t)(x - view->x + 1) * VIEW_SCALE_ONE - 1, view->scale
+    );
+}
+
+// Rectangle covering `rows` by `columns` cells starting at cell (`row`,
+// `column`)
+static inline SDL_Rect view_cells_rect(
+    const View *view, int row, int column, int rows, int columns
+)
+{
+    int left = view_edge(view, column);
+    int top  = view_edge(view, row);
+    return (SDL_Rect){
+        .x = view->x + left,
+        .y = view->y + top,
+        .w = view_edge(view, column + columns) - left,
+        .h = view_edge(view, row + rows) - top
+    };
+}
+
+static inline SDL_Rect view_cell_rect(const View *view, int row, int column)
+{
+    return view_cells_rect(view, row, column, 1, 1);
+}
+
+// Changes the scale of `view` to `scale`, keeping the point at `x`, `y` in
+// place
+static inline void view_zoom_at(View *view, int scale, int x, int y)
+{
+    view->x     = x - (int)((int64_t)(x - view->x) * scale / view->scale);
+    view->y     = y - (int)((int64_t)(y - view->y) * scale / view->scale);
+    view->scale = scale;
+}
+
+// Finds the cells of a canvas with `rows` by `columns` cells that are at
+// least partly inside `area`. Returns false if there are none.
+static inline bool view_visible_cells(
+    const View *view, SDL_Rect area, int rows, int columns, CellRange *range
+)
+{
+    int top, left, bottom, right;
+    view_screen_to_cell(view, area.x, area.y, &top, &left);
+    view_screen_to_cell(
+        view, area.x + area.w - 1, area.y + area.h - 1, &bottom, &right
+    );
+
+    if (top < 0)
+        top = 0;
+    if (left < 0)
+        left = 0;
+    if (bottom > rows - 1)
+        bottom = rows - 1;
+    if (right > columns - 1)
+        right = columns - 1;
+
+    range->row     = top;
+    range->column  = left;
+    range->rows    = bottom - top + 1;
+    range->columns = right - left + 1;
+
+    return area.w > 0 && area.h > 0 && range->rows > 0 && range->columns > 0;
+}
+
+#endif // VIEW_H